@@ -19,7 +19,9 @@
 #' @param data A list of data set corresponding to the model fits. Can be left blank if obj was obtained with the \code{dataout=TRUE} option or if obj was obtained by mice
 #' @param firth If \code{TRUE}, applies the Firth correction. Should correspond to the entry in obj.
 #' @param weightvar An optional weighting variable for each observation. 
-#' @param control Control parameters for \code{logistf}, usually obtained by \code{logistf.control()}
+#' @param control Control parameters for \code{logistf}, usually obtained by \code{logistf.control()}. 
+#' Without offset and with \code{legacy=FALSE}, each evaluation of the posterior refits all imputed data sets 
+#' in one call, in parallel with \code{threads} > 1.
 #' @param ci.level The two confidence levels for each tail of the posterior distribution.
 #' @param pvalue If \code{TRUE}, will also compute a P-value from the posterior.
 #' @param offset An optional offset variable
@@ -212,12 +214,22 @@ CLIP.confint <- function(obj=NULL, variable=NULL, data, firth=TRUE, weightvar=NU
     beta<-t(matrix(unlist(lapply(1:imputations,function(x) fits[[x]]$coefficients)),k,imputations))
     
 
+    # the posterior is evaluated many times per imputed data set: prepare each data set once
+    designs <- if(is.null(offset) & !old) lapply(1:imputations, function(zz) logistf.design(x=xyw[imputation.indicator==zz,1:k], 
+                      y=xyw[imputation.indicator==zz,k+1], weight=xyw[imputation.indicator==zz,k+2])) else NULL
+    
     lpdf<-function(zz,z) logistf.pdf(x=xyw[imputation.indicator==zz,1:k], y=xyw[imputation.indicator==zz,k+1], 
                                      weight=xyw[imputation.indicator==zz,k+2], beta=beta[zz,],loglik=loglik[zz],
-                                     pos=pos, firth=firth, offset=offset, control=control, b=z, old=old)$pdf
+                                     pos=pos, firth=firth, offset=offset, control=control, b=z, old=old, design=designs[[zz]])$pdf
     
-    f=function(z)  mean(unlist(lapply(1:imputations, function(zz) {lpdf(zz,z)}
-    )))
+    # with the prepared designs, all data sets are fitted in one call per evaluation (in parallel with 
+    # control$threads > 1), each starting from its fit at the previous evaluation for the same limit
+    warm <- t(beta)
+    f <- if(!is.null(designs)) function(z) {
+      xx <- logistf.pdf.imp(designs, pos=pos, firth=firth, control=control, b=z, beta=beta, loglik=loglik, init=warm)
+      warm <<- xx$beta
+      mean(xx$pdf)
+    } else function(z) mean(unlist(lapply(1:imputations, function(zz) lpdf(zz,z))))
     f.lower<-f(lowerbound.lo)-ci.level[1]
     f.upper<-f(upperbound.lo)-ci.level[1]
     iter[1]<-2
@@ -249,6 +261,7 @@ CLIP.confint <- function(obj=NULL, variable=NULL, data, firth=TRUE, weightvar=NU
     ci[1]<-res.ci$root
     iter[1]<-res.ci$iter+iter[1]
 
+    warm <- t(beta)
     f.lower<-f(lowerbound.up)-ci.level[2]
     f.upper<-f(upperbound.up)-ci.level[2]
     iter[2]<-2
@@ -279,6 +292,7 @@ CLIP.confint <- function(obj=NULL, variable=NULL, data, firth=TRUE, weightvar=NU
     iter[2]<-res.ci$iter+iter[2]
     
     if (pvalue=="TRUE") {
+      warm <- t(beta)
       pvalue1<-f(0)
       pvalue<-2*min(pvalue1, (1-pvalue1))   # two-sided = twice smaller tail
     }
@@ -187,21 +187,34 @@ CLIP.profile <- function(obj=NULL, variable, data, which, firth=TRUE, weightvar,
   beta<-t(matrix(unlist(lapply(1:imputations,function(x) fits[[x]]$coefficients)),k,imputations))
   
   
+  # the posterior is evaluated many times per imputed data set: prepare each data set once
+  designs <- if(is.null(offset) & !old) lapply(1:imputations, function(zz) logistf.design(x=xyw[imputation.indicator==zz,1:k], 
+                    y=xyw[imputation.indicator==zz,k+1], weight=xyw[imputation.indicator==zz,k+2])) else NULL
+  
   lpdf<-function(zz,z) logistf.pdf(x=xyw[imputation.indicator==zz,1:k], y=xyw[imputation.indicator==zz,k+1], 
                                    weight=xyw[imputation.indicator==zz,k+2], beta=beta[zz,],loglik=loglik[zz],
-                                   pos=pos, firth=firth, offset=offset, control=control, b=z, old=old)$pdf
+                                   pos=pos, firth=firth, offset=offset, control=control, b=z, old=old, design=designs[[zz]])$pdf
   
   z_seq<-seq(from, to, (to-from)/steps)
   
+  # with the prepared designs, all data sets are fitted in one call per point of z_seq (in parallel with 
+  # control$threads > 1), each starting from its fit at the previous point
+  warm <- t(beta)
+  lpdfs <- if(!is.null(designs)) function(z) {
+    xx <- logistf.pdf.imp(designs, pos=pos, firth=firth, control=control, b=z, beta=beta, loglik=loglik, init=warm)
+    warm <<- xx$beta
+    xx$pdf
+  } else function(z) unlist(lapply(1:imputations, function(zz) lpdf(zz,z)))
+  
   if(keep==FALSE){
-    f=function(z)  mean(unlist(lapply(1:imputations, function(zz) lpdf(zz,z))))
+    f=function(z)  mean(lpdfs(z))
     ### lasse z laufen von from nach to
     ### evaluiere f an allen z's und errechne daraus profile
     pdf_mat<-NULL
     profile.mat<-NULL
     pdf_seq<-unlist(lapply(z_seq, function(Z) f(Z)))
   } else {
-    f=function(z)  unlist(lapply(1:imputations, function(zz) lpdf(zz,z)))
+    f=function(z)  lpdfs(z)
     #   pdf_mat<-matrix(0,steps+1,imputations)
     pdf_mat<-matrix(unlist(lapply(z_seq, function(Z) f(Z))), imputations, steps+1)   
     profile.mat<- -qnorm(pdf_mat)**2
@@ -2,8 +2,16 @@
 #'
 #' These functions provide simple backward elimination/forward selection procedures for logistf models.
 #' 
-#' The variable selection is simply performed by repeatedly calling add1 or drop1 methods for logistf, 
-#' and is based on penalized likelihood ratio test.
+#' The variable selection is based on penalized likelihood ratio tests, as computed by the add1 or drop1 
+#' methods for logistf. The design of all terms that may enter the model is built once and all steps run 
+#' in one call of the C code: at each step the tests of all candidate terms are computed from fits that 
+#' start from the estimates of the current model (in parallel with \code{threads > 1} in 
+#' \code{\link{logistf.control}}), and only the finally selected model is fitted by \code{logistf}.
+#' Each model is fitted on the columns of its own terms, so its penalty and the tests are those of add1 
+#' or drop1.
+#' With \code{printwork = TRUE}, \code{full.penalty = TRUE}, \code{flic} or \code{flac} fits, or if 
+#' candidate terms have missing values in observations of the model, the selection instead repeatedly 
+#' calls add1 or drop1 and refits each working model.
 #' 
 #' Note that selecting among factor variables is not supported.
 #' One way to use forward or backward with factor variables is to first convert them
@@ -37,6 +45,17 @@
 #' fit2<-logistf(data=sex2, case~age+oc+vic+vicl+vis+dia) 
 #' fitb<-backward(fit2, data=sex2)
 #' 
+#' # the native selection against the one by drop1 and add1 (printwork = TRUE): the terms selected and
+#' # their p-values in the protocol of the steps
+#' steps <- function(sel) {
+#'   w <- strsplit(grep("removed|added", capture.output(sel), value = TRUE), " +")
+#'   list(term = sapply(w, "[", 5), pval = as.numeric(sapply(w, "[", 7)))
+#' }
+#' stopifnot(all.equal(steps(backward(fit2, data=sex2)), steps(backward(fit2, data=sex2, printwork=TRUE)),
+#'                     tolerance=1e-5),
+#'           all.equal(steps(forward(fit, scope=c("dia", "age"), data=sex2)),
+#'                     steps(forward(fit, scope=c("dia", "age"), data=sex2, printwork=TRUE)), tolerance=1e-5))
+#' 
 #' @importFrom utils tail
 #' 
 #' @rdname backward
@@ -90,7 +109,26 @@ backward.logistf <- function(object, scope, data, steps=1000, slstay=0.05, trace
     removal <- vector()
     newform.fp <- working$formula
   }
-  while(istep<steps & working$df>1){
+  sel <- NULL
+  if(!full.penalty && !printwork && identical(class(object), "logistf")){
+    #all steps in one native call on the design of the start model, the selected model fitted once
+    sel <- logistf.stepwise(working, data, direction=-1, lower=colnames(fdrop), sl=slstay, steps=steps)
+  }
+  if(!is.null(sel)){
+    newform <- working$formula
+    nopl <- FALSE
+    for(istep in seq_along(sel$term)){
+      newform <- update.formula(newform, paste("~ . -", sel$term[istep]))
+      nopl <- nopl | working$df==2 | working$df==sel$df[istep]
+      working$df <- working$df-sel$df[istep]
+      if(trace) cat("Step ", istep, ": removed ", sel$term[istep], " (P=", sel$pval[istep],")\n")
+    }
+    if(length(sel$term)){
+      if(nopl) working<-update(working, formula=newform, data = data, pl=FALSE)
+      else working<-update(working, formula=newform, data = data)
+    }
+  }
+  while(is.null(sel) && istep<steps & working$df>1){
     #check p-value of variables in scope
     inscope <- attr(Terms, "factors")
     inscope <- factor.scope(inscope, list(drop = fdrop))$drop
@@ -203,7 +241,21 @@ forward.logistf<-function(object, scope, data, steps=1000, slentry=0.05, trace=T
   }
 
   inscope<-scope
-  while(istep<steps & length(inscope)>=1){
+  sel <- NULL
+  if(!printwork && identical(class(object), "logistf")){
+    #all steps in one native call on the design of all terms in scope, the selected model fitted once
+    sel <- logistf.stepwise(working, data, direction=1, scope=inscope, sl=slentry, steps=steps)
+  }
+  if(!is.null(sel)){
+    newform <- working$formula
+    for(istep in seq_along(sel$term)){
+      newform <- update.formula(newform, paste("~.+", sel$term[istep]))
+      if(trace) cat("Step ", istep, ": added ", sel$term[istep], " (P=", sel$pval[istep],")\n")
+    }
+    if(length(sel$term)) working<-update(working, formula=newform, pl=pl, data = data)
+    else if(pl) working<-update(working, pl=TRUE, data = data)
+  }
+  while(is.null(sel) && istep<steps & length(inscope)>=1){
     istep<-istep+1
     mat<-add1(working, scope = inscope, data = data)
     if(all(mat[,3]>slentry)) break
@@ -224,7 +276,7 @@ forward.logistf<-function(object, scope, data, steps=1000, slentry=0.05, trace=T
       }
     }
   }
-   if(pl) working<-update(working, pl=TRUE, data = data)
+   if(is.null(sel) && pl) working<-update(working, pl=TRUE, data = data)
    if(trace) cat("\n")
    return(working)
 }
\ No newline at end of file
@@ -16,6 +16,14 @@
 #' @param xconv Specifies the convergence criterion for the parameter estimates.
 #' @param ortho Requests orthogonalization of variable for which confidence intervals are computed with respect to other covariates
 #' @param pr Request rotation of the matrix spanned by the covariates
+#' @param lowmem If \code{TRUE}, no weighted copies of the design matrix are kept during the iterations 
+#' (workspace of order n + k^2 instead of n x k). See \code{\link{logistf.control}}.
+#' @param accelerate If \code{TRUE}, each search starts from an extrapolation of the limit along the Wald 
+#' direction (a few evaluations of the likelihood) instead of the maximum, and steps that shrink geometrically 
+#' are extended by a secant extrapolation. Gives the same limits in fewer iterations (see \code{pl.iter} of 
+#' \code{logistf}); requires the initial values to be the maximum likelihood estimates.
+#' @param trace If \code{TRUE}, each limit search records a trace as with \code{\link{logistf.control}(trace = TRUE)} 
+#' (the score is that at the start of an iteration); returned by \code{logistf()} as \code{pl.trace}.
 #'
 #' @return
 #'    \item{maxit}{The maximum number of iterations}
@@ -27,6 +35,9 @@
 #'    \item{xconv}{Specifies the convergence criterion for the parameter estimates.}
 #'    \item{ortho}{specifies if orthogonalization is requested.}
 #'    \item{pr}{specifies if rotation is requested}
+#'    \item{lowmem}{specifies if low-memory mode is requested}
+#'    \item{accelerate}{specifies if accelerated limit searches are requested}
+#'    \item{trace}{specifies if the limit searches are traced}
 #' @export
 #' 
 #' @author Georg Heinze
@@ -37,6 +48,6 @@
 #'     plcontrol=logistpl.control(maxstep=1))
 #' summary(fit2)
 #'
-logistpl.control<-function(maxit=100, maxhs=0, maxstep=5, lconv=0.00001, xconv=0.00001, ortho=FALSE, pr=FALSE){
-  list(maxit=maxit, maxhs=maxhs, maxstep=maxstep, lconv=lconv, xconv=xconv, ortho=ortho, pr=pr)
+logistpl.control<-function(maxit=100, maxhs=0, maxstep=5, lconv=0.00001, xconv=0.00001, ortho=FALSE, pr=FALSE, lowmem=FALSE, accelerate=FALSE, trace=FALSE){
+  list(maxit=maxit, maxhs=maxhs, maxstep=maxstep, lconv=lconv, xconv=xconv, ortho=ortho, pr=pr, lowmem=lowmem, accelerate=accelerate, trace=trace)
 }
@@ -7,13 +7,17 @@
 #' @param variable Alternatively to which, a variable name can be given, e.g., variable="X"
 #' @param steps Number of steps in evaluating the profile likelihood
 #' @param pitch Alternatively to steps, one may specify the step width in multiples of standard errors
-#' @param limits Lower and upper limits of parameter values at which profile likelihood is to be evaluated
+#' @param limits Lower and upper limits of parameter values at which profile likelihood is to be evaluated. 
+#' Required if \code{fitted} was fitted with a subset of terms (\code{terms.fit} of \code{\link{logistf.mod.control}}); 
+#' the other terms then stay fixed at their estimates.
 #' @param alpha The significance level (1-\eqn{\alpha} the confidence level, 0.05 as default).
 #' @param firth Use of Firth's penalized maximum likelihood (\code{firth=TRUE}, default) 
 #' or the standard maximum likelihood method (\code{firth=FALSE}) for the logistic regression.
 #' @param legends legends to be included in the optional plot
 #' @param control Controls Newton-Raphson iteration. Default is \code{control= logistf.control(maxstep, 
-#' maxit, maxhs, lconv, gconv, xconv)}
+#' maxit, maxhs, lconv, gconv, xconv)}. The profile is evaluated by two chains of fits, from the estimate 
+#' down and up the grid, each starting from the fit at the neighbouring knot; with \code{threads} > 1 the two 
+#' chains run in parallel. A chain stops at the first knot with fitted probabilities numerically 0 or 1.
 #' @param plcontrol Controls Newton-Raphson iteration for the estimation of the profile likelihood 
 #' confidence intervals. Default is \code{plcontrol= logistpl.control(maxstep, maxit, maxhs, lconv, xconv, ortho, pr)}
 #' @param ... Further arguments to be passed.
@@ -94,8 +98,10 @@ function(fitted,  which, variable, steps=100, pitch = 0.05, limits,
   
   
   
-  if(!(identical(modcontrol$terms.fit, 1:k) | is.null(modcontrol$terms.fit))){
-    stop("Please call profile on a logistf-object with all terms fitted.")
+  # with a terms.fit mask the limits of the grid must be given (logistpl refits all other terms)
+  all.fit <- identical(as.integer(modcontrol$terms.fit), 1:k) | is.null(modcontrol$terms.fit)
+  if(!all.fit && missing(limits)){
+    stop("Please call profile on a logistf-object with all terms fitted, or specify limits.")
   }
   
   if(!missing(which)) {
@@ -114,9 +120,11 @@ function(fitted,  which, variable, steps=100, pitch = 0.05, limits,
   coefs <- fitted$coefficients 
   
   LL.0 <- fitted$loglik['full'] - qchisq(1 - alpha, 1)/2
+  design <- logistf.design(x, y, weight, offset, single = isTRUE(control$single), binary = isTRUE(control$binary),
+                           collapse = isTRUE(control$collapse))
   if(missing(limits)) {
-    lower.fit <- logistpl(x, y, init=fitted$coefficients, weight=weight, offset=offset, firth=firth, LL.0=LL.0, which=-1, i=pos, plcontrol=plcontrol, modcontrol = modcontrol)
-    upper.fit <- logistpl(x, y, init=fitted$coefficients, weight=weight, offset=offset, firth=firth, LL.0=LL.0, which=1, i=pos, plcontrol=plcontrol, modcontrol = modcontrol)
+    lower.fit <- logistpl(x, y, init=fitted$coefficients, weight=weight, offset=offset, firth=firth, LL.0=LL.0, which=-1, i=pos, plcontrol=plcontrol, modcontrol = modcontrol, keephist = FALSE, design = design)
+    upper.fit <- logistpl(x, y, init=fitted$coefficients, weight=weight, offset=offset, firth=firth, LL.0=LL.0, which=1, i=pos, plcontrol=plcontrol, modcontrol = modcontrol, keephist = FALSE, design = design)
     limits <- c(lower.fit$beta, upper.fit$beta)
   } 
   
@@ -131,28 +139,18 @@ function(fitted,  which, variable, steps=100, pitch = 0.05, limits,
   res[,1] <- knots
   res[,2] <- coefs[pos] + std.pos * knots
    
-  res <- res[order(abs(res[,cov.name2]-coefs[pos])),]
-  
-  #first iteration: 
-  init<-fitted$coefficients
-  init[pos]<-res[1,2]
-  xx <- logistf.fit(x, y, weight=weight, offset=offset, firth=firth, init=init,
-                     control=control, modcontrol = update(fitted$modcontrol, terms.fit = (1:k)[-pos])) 
-  res[1, 3] <- xx$loglik
-  for(i in 2:nn) {
-    init<-xx$beta
-    init[pos]<-res[i,2]
-    xx <- logistf.fit(x, y, weight=weight, offset=offset, firth=firth, init=init,
-                     control=control, modcontrol = update(fitted$modcontrol, terms.fit = (1:k)[-pos])) 
-    if(xx$warning_prob){
-      warning("fitted probabilities numerically 0 or 1 occurred.")
-      res <- res[!is.na(res[, "log-likelihood"]),]
-      break
-    } 
-    res[i, 3] <- xx$loglik
+  # all knots in one call: two chains outward from the estimate (in parallel with control$threads > 1), 
+  # each knot starting from the fit at its neighbour, with the terms of terms.fit other than pos refitted
+  grid <- logistf.profile.grid(x, y, weight=weight, offset=offset, firth=firth, init=coefs, pos=pos, 
+                               values=res[,2], terms.fit=modcontrol$terms.fit, control=control, 
+                               modcontrol=modcontrol, design=design)
+  res[,3] <- grid$loglik
+  if(grid$warning_prob){
+    warning("fitted probabilities numerically 0 or 1 occurred.")
   }
+  res <- res[!is.na(res[, "log-likelihood"]), , drop=FALSE]
   
-  res <- res[order(res[,cov.name2]),]
+  res <- res[order(res[,cov.name2]), , drop=FALSE]
   
    signed.root<-sqrt(2*(-res[,3]+max(res[,3])))*sign(res[,2]-fitted$coefficients[pos])
    cdf<-pnorm(signed.root)
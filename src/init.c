@@ -1,24 +1,55 @@
 #include <stdlib.h> // for NULL
+#include <Rinternals.h>
 #include <R_ext/Rdynload.h>
 
 /* .C calls */
 extern void linpack_choleski(void *, void *);
 extern void linpack_inv_det(void *, void *, void *);
-extern void logistffit_IRLS(void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *);
-extern void logistffit_revised(void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *);
-extern void logistplfit(void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *);
+extern void logistffit_IRLS(void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *);
+extern void logistffit_revised(void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *);
+extern void logistplfit(void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *);
+
+/* .Call calls */
+extern SEXP logistffit_call(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP logistf_design_call(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP logistplfit_call(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP logistplfit_all_call(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP logistf_submodels_call(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP logistf_stepwise_call(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP logistf_profile_call(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP logistf_clip_call(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP logistf_mi_call(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP logistplfit_mi_call(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP logistf_mmap_call(SEXP);
+extern SEXP logistf_collapse_call(SEXP, SEXP, SEXP);
 
 static const R_CMethodDef CEntries[] = {
     {"linpack_choleski",   (DL_FUNC) &linpack_choleski,    2},
     {"linpack_inv_det",    (DL_FUNC) &linpack_inv_det,     3},
-    {"logistffit_IRLS",    (DL_FUNC) &logistffit_IRLS,    25},
-    {"logistffit_revised", (DL_FUNC) &logistffit_revised, 26},
-    {"logistplfit",        (DL_FUNC) &logistplfit,        22},
+    {"logistffit_IRLS",    (DL_FUNC) &logistffit_IRLS,    27},
+    {"logistffit_revised", (DL_FUNC) &logistffit_revised, 28},
+    {"logistplfit",        (DL_FUNC) &logistplfit,        23},
+    {NULL, NULL, 0}
+};
+
+static const R_CallMethodDef CallEntries[] = {
+    {"logistffit_call",  (DL_FUNC) &logistffit_call,  8},
+    {"logistplfit_call", (DL_FUNC) &logistplfit_call, 19},
+    {"logistf_design_call", (DL_FUNC) &logistf_design_call, 6},
+    {"logistplfit_all_call", (DL_FUNC) &logistplfit_all_call, 19},
+    {"logistf_submodels_call", (DL_FUNC) &logistf_submodels_call, 7},
+    {"logistf_stepwise_call", (DL_FUNC) &logistf_stepwise_call, 13},
+    {"logistf_profile_call", (DL_FUNC) &logistf_profile_call, 9},
+    {"logistf_clip_call", (DL_FUNC) &logistf_clip_call, 5},
+    {"logistf_mi_call", (DL_FUNC) &logistf_mi_call, 6},
+    {"logistplfit_mi_call", (DL_FUNC) &logistplfit_mi_call, 14},
+    {"logistf_mmap_call", (DL_FUNC) &logistf_mmap_call, 1},
+    {"logistf_collapse_call", (DL_FUNC) &logistf_collapse_call, 3},
     {NULL, NULL, 0}
 };
 
 void R_init_logistf(DllInfo *dll)
 {
-    R_registerRoutines(dll, CEntries, NULL, NULL, NULL);
+    R_registerRoutines(dll, CEntries, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef ___LF_PORT_H
+#define ___LF_PORT_H
+
+// Runtime of the fitting core (logistf.c, logistf_lib.c, veclib.h): by default R, whose headers provide
+// BLAS/LAPACK, R_alloc and error(). Compiled with -DLOGISTF_STANDALONE (see standalone/Makefile) the core
+// only needs the C library and a BLAS/LAPACK: workspace then comes from arenas with caller-provided
+// allocators, and errors are returned as status codes (LF_NOMEM, ...) instead of raised by longjmp.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LOGISTF_STANDALONE
+
+#include <stdio.h>
+
+#define F77_CALL(x)	x ## _
+#define F77_NAME(x)	x ## _
+#define FCONE
+#define Rprintf		printf
+#define R_PosInf	INFINITY
+
+// Fortran BLAS/LAPACK routines used by veclib.h
+void dgemv_(const char *trans, const int *m, const int *n, const double *alpha, const double *a, const int *lda,
+	const double *x, const int *incx, const double *beta, double *y, const int *incy);
+void dgemm_(const char *transa, const char *transb, const int *m, const int *n, const int *k, const double *alpha,
+	const double *a, const int *lda, const double *b, const int *ldb, const double *beta, double *c, const int *ldc);
+void dsyrk_(const char *uplo, const char *trans, const int *n, const int *k, const double *alpha, const double *a,
+	const int *lda, const double *beta, double *c, const int *ldc);
+void dtrsm_(const char *side, const char *uplo, const char *transa, const char *diag, const int *m, const int *n,
+	const double *alpha, const double *a, const int *lda, double *b, const int *ldb);
+void dpotrf_(const char *uplo, const int *n, double *a, const int *lda, int *info);
+void dpotrs_(const char *uplo, const int *n, const int *nrhs, const double *a, const int *lda, double *b,
+	const int *ldb, int *info);
+void dpotri_(const char *uplo, const int *n, double *a, const int *lda, int *info);
+
+#else
+
+#define USE_FC_LEN_T				// pass hidden string lengths to Fortran
+
+#include <R.h>
+#include <Rdefines.h>
+#include <R_ext/Linpack.h>	// inverse; choleski; determinant
+#include <R_ext/Lapack.h>		// dpotrf, dpotrs, dpotri
+#include <R_ext/BLAS.h>			// dgemm, dgemv, dsyrk, dtrsm
+#include "Rmath.h"					// random numbers; distributions
+
+#endif
+
+#ifndef FCONE
+# define FCONE
+#endif
+
+// monotonic clock in seconds (instrumentation of the fitting routines)
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOGDI
+#define NOGDI
+#endif
+#include <windows.h>
+static inline double lf_clock(void)
+{
+	LARGE_INTEGER f, c;
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+	return (double) c.QuadPart / (double) f.QuadPart;
+}
+#else
+#include <time.h>
+static inline double lf_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+}
+#endif
+
+#endif
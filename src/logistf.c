@@ -1,17 +1,396 @@
-#include <math.h>
-#include <R.h>
-#include <Rdefines.h>
-#include "memory.h"
-#include "Rmath.h"
+#include "lf_port.h"
 #include "veclib.h"
+#include "logistf.h"
 
-void logistffit_revised(double *x, int *y, int *n_l, int *k_l, 
-                double *weight, double *offset, 
+// Workspace of the fitting routines: buffers are carved from the arena ws if one is given (prepared
+// designs, see logistf_call.c) and allocated by R_alloc for the duration of the call otherwise.
+// An arena that is too small falls back to R_alloc; the total requested is recorded in ws->need,
+// so ws_reserve() can grow the arena for the next call.
+// An arena in collect mode (fits run in parallel, see logistf_submodels_call) never falls back to
+// R_alloc and the fitting routines do not raise R errors on it: they return with ws->status set.
+// The standalone library (LOGISTF_STANDALONE) has no R_alloc and always behaves as in collect mode.
+void ws_reset(lf_arena *ws)
+{
+  if(ws != NULL) {
+    ws->used = ws->need = 0;
+    ws->status = LF_OK;
+  }
+}
+
+void *ws_alloc(lf_arena *ws, size_t count, size_t size)
+{
+  size_t bytes = (count * size + 63) & ~((size_t) 63);  // keep buffers on 64-byte boundaries
+  void *p;
+
+#ifdef LOGISTF_STANDALONE
+  if(ws == NULL)
+    return NULL;
+  ws->need += bytes;
+  if(ws->used + bytes > ws->size)
+    return NULL;
+#else
+  if(ws == NULL)
+    return R_alloc(count, size);
+  ws->need += bytes;
+  if(ws->used + bytes > ws->size)
+    return ws->collect ? NULL : R_alloc(count, size);
+#endif
+  p = ws->base + ws->used;
+  ws->used += bytes;
+  return p;
+}
+
+// grow the arena to the size requested by the last call, by its allocator (malloc if none);
+// returns LF_NOMEM if that fails (raised as an R error in the R package)
+int ws_reserve(lf_arena *ws)
+{
+  if(ws->need <= ws->size)
+    return LF_OK;
+  ws_free(ws);
+  ws->base = (char *) (ws->allocator != NULL ? ws->allocator->alloc(ws->need, ws->allocator->ctx) : malloc(ws->need));
+  if(ws->base == NULL) {
+#ifndef LOGISTF_STANDALONE
+    error("no memory available\n");
+#endif
+    return LF_NOMEM;
+  }
+  ws->size = ws->need;
+  return LF_OK;
+}
+
+void ws_free(lf_arena *ws)
+{
+  if(ws->base != NULL) {
+    if(ws->allocator != NULL)
+      ws->allocator->free(ws->base, ws->allocator->ctx);
+    else
+      free(ws->base);
+  }
+  ws->base = NULL;
+  ws->size = ws->used = 0;
+}
+
+// error of a fitting routine: recorded in the arena in collect mode (always in the standalone library),
+// raised as an R error otherwise
+#ifdef LOGISTF_STANDALONE
+#define FIT_ERROR(ws, code, ...) do { \
+    if((ws) != NULL) (ws)->status = (code); \
+    return; \
+  } while(0)
+#else
+#define FIT_ERROR(ws, code, ...) do { \
+    if((ws) != NULL && (ws)->collect) { (ws)->status = (code); return; } \
+    error(__VA_ARGS__); \
+  } while(0)
+#endif
+
+// Instrumentation (ws->trace, see lf_trace in logistf.h): PHASE adds the time of stmt to a phase and
+// TRACE_COUNT increments a counter; without a trace they cost the test of a pointer
+#define TRACING(ws) ((ws) != NULL && (ws)->trace != NULL)
+#define PHASE(ws, phase, stmt) do { \
+    double t0_ = TRACING(ws) ? lf_clock() : 0.0; \
+    stmt; \
+    if(TRACING(ws)) (ws)->trace->time[phase] += lf_clock() - t0_; \
+  } while(0)
+#define TRACE_COUNT(ws, counter) do { if(TRACING(ws)) (ws)->trace->counter++; } while(0)
+
+// one pass through the iteration loop of a fitting routine, with halfs halvings (or rejected trial steps)
+static void trace_iteration(lf_arena *ws, double loglik, double delta, double score, int halfs)
+{
+  lf_trace *tr = ws->trace;
+  tr->halvings += halfs;
+  if(tr->niter < tr->maxiter) {
+    tr->loglik[tr->niter] = loglik;
+    tr->delta[tr->niter] = delta;
+    tr->score[tr->niter] = score;
+    tr->halfs[tr->niter] = halfs;
+  }
+  tr->niter++;
+}
+
+// Per-observation kernels shared by the fitting routines
+
+// Fused pass over the observations after beta has changed. On entry pi holds the linear predictor
+// X beta (without offset), on exit the fitted probabilities. The same pass writes the rows of X W^(1/2)
+// to xw2 (k x n) and sums the log-likelihood with a numerically stable log-sigmoid: with a = exp(-|eta|),
+// y log(pi) + (1-y) log(1-pi) = y eta - max(eta, 0) - log1p(a) and pi (1-pi) = a / (1+a)^2,
+// i.e. one exp and one log1p per observation. x is read in blocks of TILE rows, so each block of xw2
+// is written while x is streamed column by column. In low-memory mode xw2 is NULL and only the
+// weights weight pi (1-pi) are written to wt.
+// Observations i0..i1-1 only; returns 1 if fitted probabilities numerically 0 or 1 occurred.
+static int fitted_rows(double *x, int *y, double *weight, double *offset, double *pi, double *xw2,
+                       double *wt, double *loglik, long n, long k, long i0, long i1)
+{
+  long i, j, t0, t1;
+  double eta, a, ll = 0.0;
+  double sw[TILE];
+  int bad = 0;
+
+  for(t0 = i0; t0 < i1; t0 += TILE) {
+    t1 = (t0 + TILE < i1) ? t0 + TILE : i1;
+    for(i = t0; i < t1; i++) {
+      eta = pi[i] + offset[i];
+      a = exp(-fabs(eta));
+      pi[i] = ((eta >= 0.0) ? 1.0 : a) / (1.0 + a);
+      ll += weight[i] * (y[i] * eta - fmax(eta, 0.0) - log1p(a));
+      bad |= (pi[i] == 0.0) | (pi[i] == 1.0);
+      sw[i - t0] = sqrt(weight[i] * a) / (1.0 + a);
+    }
+    if(xw2 != NULL) {
+      for(j = 0; j < k; j++)
+        for(i = t0; i < t1; i++)
+          xw2[i*k + j] = x[i + j*n] * sw[i - t0];
+    } else {
+      for(i = t0; i < t1; i++)
+        wt[i] = sw[i - t0] * sw[i - t0];
+    }
+  }
+  *loglik = ll;
+  return bad;
+}
+
+// fitted_rows for all observations, split into 'threads' blocks whose log-likelihoods are summed
+// in block order (part: workspace of at least threads doubles)
+static int fitted_pass(double *x, int *y, double *weight, double *offset, double *pi, double *xw2,
+                       double *wt, double *loglik, long n, long k, int threads, double *part)
+{
+  int blk, bad = 0;
+
+  #pragma omp parallel for num_threads(threads) schedule(static) reduction(|:bad)
+  for(blk = 0; blk < threads; blk++) {
+    long i0, i1;
+    block_range(n, threads, blk, &i0, &i1);
+    bad |= fitted_rows(x, y, weight, offset, pi, xw2, wt, part + blk, n, k, i0, i1);
+  }
+  *loglik = part[0];
+  for(blk = 1; blk < threads; blk++)
+    *loglik += part[blk];
+  return bad;
+}
+
+#define IS_SPARSE(xs) ((xs) != NULL && (xs)->type == LF_XSPARSE)
+#define IS_FLOAT(xs) ((xs) != NULL && (xs)->type == LF_XFLOAT)
+#define IS_MIXED(xs) ((xs) != NULL && (xs)->type == LF_XMIXED)
+
+// Linear predictor X b and X'w of the dense design x or its alternative storage xs (if not NULL)
+static void design_XY(double *x, lf_xstore *xs, double *b, double *res, long n, long k, int threads)
+{
+  if(IS_SPARSE(xs))
+    spXYpar(xs->rowptr, xs->col, xs->val, b, res, n, threads);
+  else if(IS_FLOAT(xs))
+    fXYpar(xs->xf, b, res, n, k, threads);
+  else if(IS_MIXED(xs))
+    mXYpar(xs->bits, xs->xd, xs->cidx, b, res, n, k, threads);
+  else
+    XYpar(x, b, res, n, k, threads);
+}
+
+static void design_XtY(double *x, lf_xstore *xs, double *w, double *res, long n, long k, int threads, double *part)
+{
+  if(IS_SPARSE(xs))
+    spXtYpar(xs->rowptr, xs->col, xs->val, w, res, n, k, threads, part);
+  else if(IS_FLOAT(xs))
+    fXtYpar(xs->xf, w, res, n, k, threads, part);
+  else if(IS_MIXED(xs))
+    mXtYpar(xs->bits, xs->xd, xs->cidx, w, res, n, k, threads, part);
+  else
+    XtYpar(x, w, res, n, k, threads, part);
+}
+
+// Rows i0..i1-1 of x[, selcol] (all columns if selcol is NULL) times sqrt(wt) ; result is ncol x (i1-i0).
+// A single precision design xs (if not NULL) is read instead of x; the rows are formed in double.
+static void weighted_rows(double *x, lf_xstore *xs, double *wt, int *selcol, long ncol, double *res, long n, long i0, long i1)
+{
+  long i, j, col;
+  double sw[TILE];
+
+  for(i = i0; i < i1; i++)
+    sw[i - i0] = sqrt(wt[i]);
+  for(j = 0; j < ncol; j++) {
+    col = (selcol != NULL) ? selcol[j] : j;
+    if(IS_FLOAT(xs)) {
+      for(i = i0; i < i1; i++)
+        res[(i - i0)*ncol + j] = (double) xs->xf[i + col*n] * sw[i - i0];
+    } else {
+      for(i = i0; i < i1; i++)
+        res[(i - i0)*ncol + j] = x[i + col*n] * sw[i - i0];
+    }
+  }
+}
+
+// Fisher information X^TWX of the columns selcol (all if NULL) ; result is ncol x ncol.
+// From the rows of X W^(1/2) in xw (ncol x n) if they were formed; in low-memory mode (xw NULL) x is
+// read in place and TILE weighted rows at a time are formed in buf (threads * TILE * ncol)
+// and added to the per-block sums in part (threads * ncol * ncol); a sparse or mixed design xs uses buf (k x k)
+// and part (threads * k * k) for the products of the nonzeros or set bits of each row
+static void fisher_pass(double *x, lf_xstore *xs, double *xw, double *wt, int *selcol, long ncol, double *res,
+                        long n, long k, int threads, double *part, double *buf)
+{
+  int blk;
+  long i, j;
+
+  if(xw != NULL) {
+    XXtpar(xw, res, ncol, n, threads, part);
+    return;
+  }
+  // sparse or mixed design: all k columns, the selected ones are picked from the k x k result in buf
+  if(IS_SPARSE(xs) || IS_MIXED(xs)) {
+    double *full = (selcol != NULL) ? buf : res;
+    if(IS_SPARSE(xs))
+      spXtWXpar(xs->rowptr, xs->col, xs->val, wt, full, n, k, threads, part);
+    else
+      mXtWXpar(xs->bits, xs->xd, xs->cidx, wt, full, n, k, threads, part);
+    if(selcol != NULL)
+      for(j = 0; j < ncol; j++)
+        for(i = 0; i < ncol; i++)
+          res[i + j*ncol] = full[selcol[i] + selcol[j]*k];
+    return;
+  }
+  #pragma omp parallel for num_threads(threads) schedule(static)
+  for(blk = 0; blk < threads; blk++) {
+    long i0, i1, t0, t1, l;
+    double *acc = part + blk*ncol*ncol, *tb = buf + blk*TILE*ncol;
+    block_range(n, threads, blk, &i0, &i1);
+    for(l = 0; l < ncol*ncol; l++)
+      acc[l] = 0.0;
+    for(t0 = i0; t0 < i1; t0 += TILE) {
+      t1 = (t0 + TILE < i1) ? t0 + TILE : i1;
+      weighted_rows(x, xs, wt, selcol, ncol, tb, n, t0, t1);
+      XXtacc(tb, acc, ncol, t1 - t0);
+    }
+  }
+  copy(part, res, ncol*ncol);
+  for(blk = 1; blk < threads; blk++)
+    for(i = 0; i < ncol*ncol; i++)
+      res[i] += part[blk*ncol*ncol + i];
+  for(j = 0; j < ncol; j++)
+    for(i = 0; i < j; i++)
+      res[i + j*ncol] = res[j + i*ncol];
+}
+
+// Length of buf of the low-memory passes: tiles of weighted rows, k x k for a sparse design, k x k and
+// the nonzeros of a row per thread for a mixed design
+static size_t lowmem_buf(lf_xstore *xs, long k, int threads)
+{
+  if(IS_SPARSE(xs))
+    return k * k;
+  if(IS_MIXED(xs))
+    return k * k + threads * 2 * k;
+  return threads * TILE * k;
+}
+
+// Hat matrix diagonal from the Cholesky factor L of X^TWX ; from xw (k x n) if formed,
+// otherwise from TILE weighted rows of x at a time in buf (threads * TILE * k). For a sparse or mixed
+// design xs the inverse of X^TWX is formed in buf (k x k) and applied to the nonzeros of each row.
+static void hatdiag_pass(double *L, double *x, lf_xstore *xs, double *xw, double *wt, double *Hdiag,
+                         long n, long k, int threads, double *buf)
+{
+  int blk;
+
+  if(xw != NULL) {
+    chol_hatdiagpar(L, xw, Hdiag, k, n, threads);
+    return;
+  }
+  if(IS_SPARSE(xs)) {
+    chol_inv(L, buf, k);
+    sphatdiagpar(xs->rowptr, xs->col, xs->val, buf, wt, Hdiag, n, k, threads);
+    return;
+  }
+  if(IS_MIXED(xs)) {
+    chol_inv(L, buf, k);
+    mhatdiagpar(xs->bits, xs->xd, xs->cidx, buf, wt, Hdiag, n, k, threads, buf + k*k);
+    return;
+  }
+  #pragma omp parallel for num_threads(threads) schedule(static)
+  for(blk = 0; blk < threads; blk++) {
+    long i0, i1, t0, t1;
+    double *tb = buf + blk*TILE*k;
+    block_range(n, threads, blk, &i0, &i1);
+    for(t0 = i0; t0 < i1; t0 += TILE) {
+      t1 = (t0 + TILE < i1) ? t0 + TILE : i1;
+      weighted_rows(x, xs, wt, NULL, k, tb, n, t0, t1);
+      chol_hatdiag(L, tb, Hdiag + t0, k, t1 - t0);
+    }
+  }
+}
+
+// Score contributions w, U* = X'w:
+// weight (y - pi) + 2 tau h (0.5 - pi) if firth, weight (y - pi) otherwise
+static void score_pass(int *y, double *weight, double *pi, double *Hdiag, double tau, long firth,
+                       double *w, long n, int threads)
+{
+  long i;
+  if(firth) {
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for(i = 0; i < n; i++)
+      w[i] = weight[i] * ((double)y[i] - pi[i]) + 2.0 * tau * Hdiag[i] * (0.5 - pi[i]);
+  } else {
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for(i = 0; i < n; i++)
+      w[i] = weight[i] * ((double)y[i] - pi[i]);
+  }
+}
+
+// Rows of x[, selcol] (all k columns if selcol is NULL) times the square roots of the weights of
+// the augmented Fisher information, (weight + 2 tau h) pi (1-pi) if firth and weight pi (1-pi) otherwise;
+// the weights themselves are returned in wa unless it is NULL. Low-memory mode passes xwa = NULL.
+static void augmented_pass(double *x, double *weight, double *pi, double *Hdiag, double tau, long firth,
+                           int *selcol, long ncol, double *xwa, double *wa, long n, int threads)
+{
+  long t, ntile = (n + TILE - 1) / TILE;
+
+  #pragma omp parallel for num_threads(threads) schedule(static)
+  for(t = 0; t < ntile; t++) {
+    long i, j, col, i0 = t * TILE, i1 = (i0 + TILE < n) ? i0 + TILE : n;
+    double wi, sw[TILE];
+    for(i = i0; i < i1; i++) {
+      wi = (firth ? weight[i] + 2.0 * tau * Hdiag[i] : weight[i]) * pi[i] * (1.0 - pi[i]);
+      sw[i - i0] = sqrt(wi);
+      if(wa != NULL)
+        wa[i] = wi;
+    }
+    if(xwa == NULL)
+      continue;
+    for(j = 0; j < ncol; j++) {
+      col = (selcol != NULL) ? selcol[j] : j;
+      for(i = i0; i < i1; i++)
+        xwa[i*ncol + j] = x[i + col*n] * sw[i - i0];
+    }
+  }
+}
+
+
+// Log-likelihood at beta, e.g. for the trial steps of step-halving: the fused pass and, if firth or
+// factor, X^TWX with its Cholesky factor in fisher_chol and its log-determinant (the penalty is
+// tau * logdet), but not the hat diagonal and augmented quantities, which are only needed once a step
+// is accepted. Returns 0, 1 if fitted probabilities numerically 0 or 1 occurred (X^TWX is still
+// factorized) or 2 if X^TWX is numerically singular.
+static int evaluate_loglik(double *x, lf_xstore *xs, int *y, double *weight, double *offset, double *beta, double *pi,
+                           double *xw2, double *wt, double *fisher, double *fisher_chol, long firth, int factor,
+                           double *loglik_data, double *logdet, long n, long k, int nthreads, double *part, double *buf,
+                           lf_arena *ws)
+{
+  int bad, singular;
+
+  *logdet = 0.0;
+  PHASE(ws, LF_PH_LIK,
+        design_XY(x, xs, beta, pi, n, k, nthreads);
+        bad = fitted_pass(x, y, weight, offset, pi, xw2, wt, loglik_data, n, k, nthreads, part));
+  if(!firth && !factor)
+    return bad;
+  PHASE(ws, LF_PH_GRAM, fisher_pass(x, xs, xw2, wt, NULL, k, fisher, n, k, nthreads, part, buf));
+  PHASE(ws, LF_PH_CHOL,
+        singular = chol_factor(fisher, fisher_chol, k) != 0 || (*logdet = chol_logdet(fisher_chol, k)) < (-200));
+  return singular ? 2 : bad;
+}
+
+void logistffit_revised_ws(double *x, lf_xstore *xs, int *y, int *n_l, int *k_l,
+                double *weight, double *offset,
                 double *beta,
-                int *colfit, int *ncolfit_l, int *firth_l, 
+                int *colfit, int *ncolfit_l, int *firth_l,
                 int *maxit, double *maxstep, int *maxhs,
-                double *lconv, double *gconv, double *xconv, double* tau, 
-                // output: 
+                double *lconv, double *gconv, double *xconv, double* tau, int *threads, int *lowmem,
+                // output:
                 double *fisher_cov,		// k x k
                 double *Ustar,				// k
                 double *pi,						// n
@@ -20,323 +399,210 @@ void logistffit_revised(double *x, int *y, int *n_l, int *k_l,
                 int *evals,
                 int *iter,
                 double *convergence, // 3
-                int *warning_prob
+                int *warning_prob,
+                lf_arena *ws
 )
 {
   long n = (long)*n_l, k = (long)*k_l, firth = (long)*firth_l, ncolfit = (long)*ncolfit_l;
-  double wi, logdet;
+  int nthreads = (*threads > 1) ? *threads : 1;
+  double logdet, loglik_data;
   long i, j, halfs;
   double loglik_old, loglik_change = 5.0;
-  
-  double *xt;
+  int bad, status, current;
+
   double *xw2;
-  double *xw2t;
-  double *tmp;
+  double *part;
+  double *wt;
+  double *buf;
+  double *fisher_chol;
   double *beta_old;
   double *w;
   double *xw2_reduced_augmented;
-  double *xw2_reduced_augmented_t;
   double *fisher_cov_reduced_augmented;
-  double *cov_augmented;
+  double *fisher_chol_reduced_augmented;
   double *delta;
+  double *delta_reduced;
   int *selcol;
-  
+
   // memory allocations
-  if (NULL == (xt = (double *) R_alloc(n * k, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (xw2 = (double *) R_alloc(k * n, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (xw2t = (double *) R_alloc(n * k, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (tmp = (double *) R_alloc(n * k, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (beta_old = (double *) R_alloc(k, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (w = (double *) R_alloc(n, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (xw2_reduced_augmented = (double *) R_alloc(n*ncolfit, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (xw2_reduced_augmented_t = (double *) R_alloc(n*ncolfit, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (fisher_cov_reduced_augmented = (double *) R_alloc(ncolfit*ncolfit, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (cov_augmented = (double *) R_alloc(k*k, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (delta = (double *) R_alloc(k, sizeof(double)))){ error("no memory available\n");}
-  if (NULL == (selcol = (int *) R_alloc(ncolfit, sizeof(double)))){ error("no memory available\n");}
-  
-  //Initialise delta: 
+  ws_reset(ws);
+  // low-memory mode: no n x k copies of the design, X^TWX and the hat diagonal are streamed from x
+  if(*lowmem || xs != NULL) {
+    xw2 = xw2_reduced_augmented = NULL;
+    if (NULL == (wt = (double *) ws_alloc(ws, n, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+    if (NULL == (buf = (double *) ws_alloc(ws, lowmem_buf(xs, k, nthreads), sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  } else {
+    wt = buf = NULL;
+    if (NULL == (xw2 = (double *) ws_alloc(ws, k * n, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+    if (NULL == (xw2_reduced_augmented = (double *) ws_alloc(ws, n*ncolfit, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  }
+  if (NULL == (part = (double *) ws_alloc(ws, nthreads * k * k, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (fisher_chol = (double *) ws_alloc(ws, k * k, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (beta_old = (double *) ws_alloc(ws, k, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (w = (double *) ws_alloc(ws, n, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (fisher_cov_reduced_augmented = (double *) ws_alloc(ws, ncolfit*ncolfit, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (fisher_chol_reduced_augmented = (double *) ws_alloc(ws, ncolfit*ncolfit, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (delta = (double *) ws_alloc(ws, k, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (delta_reduced = (double *) ws_alloc(ws, ncolfit, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (selcol = (int *) ws_alloc(ws, ncolfit, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+
+  //Initialise delta:
   for(i=0; i < k; i++) {
     delta[i] = 0.0;
   }
-  
+
   // which columns to select based on the columns to fit:
   for(i=0; i < ncolfit; i++){
     selcol[i] = colfit[i] - 1;
   }
-    
-  // Calculate initial likelihood
-  trans(x, xt, n, k);
-  XtY(xt, beta, pi, k, n, 1);	//init of pred prob
-  for(i = 0; i < n; i++){
-    pi[i] = 1.0 / (1.0 + exp( - pi[i] - offset[i]));	
-  }
-  
-  //Calculation of hat matrix diagonal; needed for loglik calculation on augmented dataset and in first iteration of main loop
-  //-- Calculation of X W^(1/2)
-  for(i = 0; i < n; i++) { 
-    wi = sqrt(weight[i] * pi[i] * (1.0 - pi[i]));
-    for(j = 0; j < k; j++){
-      xw2[i*k + j] = x[i + j*n] * wi; 
-    }
-  }
-  //-- Transpose: W^(1/2)^T X
-  trans(xw2, xw2t, k, n);
-  //-- Calculation of XWX
-  XtXasy(xw2t, fisher_cov, n, k);
-  //-- Invert:
-  linpack_det(fisher_cov, &k, &logdet);
-  if (logdet < (-200)) {	
-    error("In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
-  }
-  else {
-    linpack_inv(fisher_cov, &k); 
-  }
-  //-- Calculation of X W^(1/2) (X^TWX)^(-1)
-  XtY(xw2, fisher_cov, tmp, k, n, k);
-  //-- Calculation of diag(X W^(1/2) (X^TWX)^(-1) X^TW^(1/2))
-  XYdiag(tmp, xw2, Hdiag, n, k);
 
   *evals = 1, *iter = 0, *warning_prob = 0;
   int bStop = 0;
-  
-  
-  // Calculation of loglikelihood using augmented dataset if firth:
-  *loglik = 0.0;
+
+  // Calculate initial likelihood
+  //-- pred prob, X W^(1/2) and loglik in one pass
+  //-- and the factor of XWX
+  bad = evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher_cov, fisher_chol, firth, 1,
+                        &loglik_data, &logdet, n, k, nthreads, part, buf, ws);
+  if(bad == 2) {
+    FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
+  }
+  //-- Calculation of diag(X W^(1/2) (X^TWX)^(-1) X^TW^(1/2)); needed in first iteration of main loop
+  PHASE(ws, LF_PH_HAT, hatdiag_pass(fisher_chol, x, xs, xw2, wt, Hdiag, n, k, nthreads, buf));
+
+  // loglikelihood using augmented dataset if firth: the penalty is tau * log det(X^TWX)
   loglik_old = 0.0;
-  for(i = 0; i < n; i++){ 
-	  if(R_FINITE(log(1.0-pi[i])) && R_FINITE(log(pi[i]))){
-    	      *loglik += y[i] * weight[i] * log(pi[i]) + (1-y[i]) * weight[i] * log(1.0-pi[i]);
-      } else {
-          *warning_prob = 1;
-          *loglik = loglik_old;
-          bStop = 1;
-          break;
-      }
+  *loglik = loglik_data;
+  if(bad){
+    *warning_prob = 1;
+    *loglik = loglik_old;
+    bStop = 1;
   }
   if(firth){
-        	    // weight first replication of dataset with h_i * tau 
-        	    //*loglik += y[i] * Hdiag[i] * *tau * log(pi[i]) + (1-y[i]) * Hdiag[i] * *tau * log(1-pi[i]);
-        	    // weight first replication of dataset with h_i * tau with opponent y
-        	    //*loglik += (1-y[i]) * Hdiag[i] * *tau * log(pi[i]) + y[i] * Hdiag[i] * *tau * log(1-pi[i]);
-        	    
-        	    *loglik += *tau * logdet;
+    *loglik += *tau * logdet;
   }
 
   //Calculation of initial U*:
-  if(firth){
-    for(i=0; i < n; i++){
-      w[i] = ((weight[i] *(double)y[i]-pi[i]) + 2 * *tau * Hdiag[i] * (0.5 - pi[i]));
-    }
-  } else {
-    for(i=0; i < n; i++){
-      w[i] = weight[i] * ((double)y[i] - pi[i]);
-    }
-  }
-  XtY(x, w, Ustar, n, k, 1);
-  
-  //Start of iteration: 
+  PHASE(ws, LF_PH_SCORE,
+        score_pass(y, weight, pi, Hdiag, *tau, firth, w, n, nthreads);
+        design_XtY(x, xs, w, Ustar, n, k, nthreads, part));
+
+  //Start of iteration:
   if(*maxit > 0){ // in case of maxit == 0 only evaluate likelihood
     for(;;){
     //--Save iteration values:
       loglik_old = *loglik;
       copy(beta, beta_old, k);
-      
-      //--Calculation of (X^TWX)^(-1) using augmented dataset and only columns in selcol (columns to fit: colfit - 1)
+
+      //--Factorization of (X^TWX) using augmented dataset and only columns in selcol (columns to fit: colfit - 1)
       if(ncolfit > 0 && (selcol[0] != -1)) { // selcol[0] == -1 in case of just evaluating likelihood
-        //-- Calculation of X W^(1/2)
-        //---- XW^(1/2)
-
-        for(i = 0; i < n; i++) {
-          if(firth){
-            wi = sqrt((weight[i] + 2 * Hdiag[i] * *tau) * pi[i] * (1.0 - pi[i])); 
-          } else {
-            wi = sqrt(weight[i] * pi[i] * (1.0 - pi[i])); 
-          }
-          for(j = 0; j < ncolfit; j++){
-            xw2_reduced_augmented[i*ncolfit + j] =  x[i + selcol[j]*n] * wi;
-          }
+        //---- XW^(1/2) and X^TWX
+        PHASE(ws, LF_PH_GRAM,
+              augmented_pass(x, weight, pi, Hdiag, *tau, firth, selcol, ncolfit, xw2_reduced_augmented, wt, n, nthreads);
+              fisher_pass(x, xs, xw2_reduced_augmented, wt, selcol, ncolfit, fisher_cov_reduced_augmented, n, k, nthreads, part, buf));
+        PHASE(ws, LF_PH_CHOL, status = chol_factor(fisher_cov_reduced_augmented, fisher_chol_reduced_augmented, ncolfit));
+        if (status != 0) {
+          FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
         }
-        
-        
-
-        //---- W^(1/2)^T X^T
-        trans(xw2_reduced_augmented, xw2_reduced_augmented_t, ncolfit, n); 
-        XtXasy(xw2_reduced_augmented_t, fisher_cov_reduced_augmented, n, ncolfit);
-        linpack_inv(fisher_cov_reduced_augmented, &ncolfit);
-        
-        //---- Remapping of fisher_cov_(reduced)_augmented
-        for(i = 0; i < k*k; i++) { //Initialisation:
-          cov_augmented[i] = 0.0;
+
+        // Actual computation of delta: solve (X^TWX) delta = U* for the fitted columns
+        for(i=0; i < ncolfit; i++){
+          delta_reduced[i] = Ustar[selcol[i]];
         }
+        PHASE(ws, LF_PH_CHOL, chol_solve(fisher_chol_reduced_augmented, delta_reduced, ncolfit, 1));
         for(i=0; i < ncolfit; i++){
-          for(j=0; j < ncolfit; j++) {
-            cov_augmented[selcol[i] + k*selcol[j]] = fisher_cov_reduced_augmented[i + ncolfit*j];
-          }
+          delta[selcol[i]] = delta_reduced[i];
         }
-        
-        // Actual computation of delta:
-        XtY(cov_augmented, Ustar, delta, k, k, 1);
-        
+
         // Check for maxstep:
         if(*maxstep >= 0){
             double mx = maxabs(delta, k) / *maxstep;
             if(mx > 1.0){
+              TRACE_COUNT(ws, clips);
               for(i=0; i < k; i++) {
                 delta[i] /= mx;
               }
             }
           }
       }
-      
+
       //Update coefficient vector beta:
       for(i=0; i < k; i++){
         beta[i] += delta[i];
       }
-      
-      //Start step-halvings
+
+      //Start step-halvings: the trial steps only evaluate the penalized loglik, the hat diagonal and U* are
+      //computed once for the accepted beta
+      current = 0;
       for(halfs = 1; halfs <= *maxhs; halfs++) {
-        //Calculate loglik:
-        //--Update pi:
-        XtY(xt, beta, pi, k, n, 1);
-        for(i = 0; i < n; i++){
-          pi[i] = 1.0 / (1.0 + exp( - pi[i] - offset[i]));	
-        }
-        
-        //--Calculation of hat matrix diagonal;
-        //-- Calculation of X^T W^(1/2)
-        for(i = 0; i < n; i++) { 
-          wi = sqrt(weight[i] * pi[i] * (1.0 - pi[i]));
-          for(j = 0; j < k; j++)
-            xw2[i*k + j] = x[i + j*n] * wi; 
+        //Calculate loglik: pi, X^T W^(1/2) and the factor of XWX
+        status = evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher_cov, fisher_chol, firth, 1,
+                                 &loglik_data, &logdet, n, k, nthreads, part, buf, ws);
+        if(status == 2) {
+          FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
         }
-        //-- Transpose: W^(1/2)^T X
-        trans(xw2, xw2t, k, n);
-        //-- Calculation of XWX
-        XtXasy(xw2t, fisher_cov, n, k);
-        //-- Invert:
-        linpack_det(fisher_cov, &k, &logdet);
-        linpack_inv(fisher_cov, &k); 
-        //-- Calculation of X^T W^(1/2) (X^TWX)^(-1)
-        XtY(xw2, fisher_cov, tmp, k, n, k);
-        XYdiag(tmp, xw2, Hdiag, n, k);
-        
         // Calculation of loglikelihood using augmented dataset if firth:
-        *loglik = 0.0;
-        for(i = 0; i < n; i++){ 
-    	  if(R_FINITE(log(1.0-pi[i])) && R_FINITE(log(pi[i]))){
-        	      *loglik += y[i] * weight[i] * log(pi[i]) + (1-y[i]) * weight[i] * log(1.0-pi[i]);
-          } else {
-              *warning_prob = 1;
-              *loglik = loglik_old;
-              bStop = 1;
-              break;
-          }
+        *loglik = loglik_data;
+        if(status == 1){
+          *warning_prob = 1;
+          *loglik = loglik_old;
+          bStop = 1;
         }
         if(firth){
-            	    // weight first replication of dataset with h_i * tau 
-            	    //*loglik += y[i] * Hdiag[i] * *tau * log(pi[i]) + (1-y[i]) * Hdiag[i] * *tau * log(1-pi[i]);
-            	    // weight first replication of dataset with h_i * tau with opponent y
-            	    //*loglik += (1-y[i]) * Hdiag[i] * *tau * log(pi[i]) + y[i] * Hdiag[i] * *tau * log(1-pi[i]);
-            	    *loglik += *tau * logdet;
+          *loglik += *tau * logdet;
         }
         //Increase evaluation counter
         (*evals)++;
-        
+
         //Convergence check:
         if(*loglik >= (loglik_old - *lconv)){
+          current = 1;
           break;
         }
-        
-        //Calculation of U*: (needed as a return value)
-        if(firth){
-          for(i=0; i < n; i++){
-            w[i] = (weight[i] *((double)y[i]-pi[i]) + 2 * *tau * Hdiag[i] * (0.5 - pi[i]));
-          }
-        } else {
-          for(i=0; i < n; i++){
-            w[i] = weight[i] * ((double)y[i] - pi[i]);
-          }
-        }
-        XtY(x, w, Ustar, n, k, 1);
-        
+
         //Update beta:
         for(i=0; i < k; i++){
           delta[i] /= 2.0;
           beta[i] -= delta[i];
         }
       }
-      
-      if(*maxhs == 0){ //if no half stepping: Update pi and compute Hdiag for the next iteration + compute loglik to check for convergence
-        //Update predicted prob: 
-        XtY(xt, beta, pi, k, n, 1);
-        for(i = 0; i < n; i++){
-          pi[i] = 1.0 / (1.0 + exp( - pi[i] - offset[i]));	
-        }
-        //Calculation of hat matrix diagonal for next iteration; needed for loglik calculation on augmented dataset
-        //If step halfing is activated - Hdiag is computed there
-        //-- Calculation of X^T W^(1/2)
-        for(i = 0; i < n; i++) { 
-          wi = sqrt(weight[i] * pi[i] * (1.0 - pi[i]));
-          for(j = 0; j < k; j++)
-            xw2[i*k + j] = x[i + j*n] * wi; 
-        }
-        //-- Transpose: W^(1/2)^T X
-        trans(xw2, xw2t, k, n);
-        //-- Calculation of XWX
-        XtXasy(xw2t, fisher_cov, n, k);
-        //-- Invert:
-        linpack_det(fisher_cov, &k, &logdet);
-        if (logdet < (-200)) {	
-          error("In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
-        }
-        else {
-          linpack_inv(fisher_cov, &k); 
+
+      if(!current){ //no half stepping or none accepted: Update pi and XWX + compute loglik to check for convergence
+        status = evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher_cov, fisher_chol, firth, 1,
+                                 &loglik_data, &logdet, n, k, nthreads, part, buf, ws);
+        if(status == 2) {
+          FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
         }
-        //-- Calculation of X^T W^(1/2) (X^TWX)^(-1)
-        XtY(xw2, fisher_cov, tmp, k, n, k);
-        XYdiag(tmp, xw2, Hdiag, n, k);
         // Calculation of loglikelihood using augmented dataset if firth:
-        *loglik = 0.0;
-        for(i = 0; i < n; i++){ 
-    	  if(R_FINITE(log(1.0-pi[i])) && R_FINITE(log(pi[i]))){
-        	      *loglik += y[i] * weight[i] * log(pi[i]) + (1-y[i]) * weight[i] * log(1.0-pi[i]);
-          } else {
-              *warning_prob = 1;
-              *loglik = loglik_old;
-              bStop = 1;
-              break;
-          }
+        *loglik = loglik_data;
+        if(status == 1){
+          *warning_prob = 1;
+          *loglik = loglik_old;
+          bStop = 1;
         }
         if(firth){
-            	    // weight first replication of dataset with h_i * tau 
-            	    //*loglik += y[i] * Hdiag[i] * *tau * log(pi[i]) + (1-y[i]) * Hdiag[i] * *tau * log(1-pi[i]);
-            	    // weight first replication of dataset with h_i * tau with opponent y
-            	    //*loglik += (1-y[i]) * Hdiag[i] * *tau * log(pi[i]) + y[i] * Hdiag[i] * *tau * log(1-pi[i]);
-            	    
-            	    *loglik += *tau * logdet;
+          *loglik += *tau * logdet;
         }
         //Increase evaluation counter
         (*evals)++;
-        
-        //Calculation of U*:
-        if(firth){
-          for(i=0; i < n; i++){
-            w[i] = (weight[i] *((double)y[i]-pi[i]) + 2 * *tau * Hdiag[i] * (0.5 - pi[i]));
-          }
-        } else {
-          for(i=0; i < n; i++){
-            w[i] = weight[i] * ((double)y[i] - pi[i]);
-          }
-        }
-        XtY(x, w, Ustar, n, k, 1);
       }
-      
+
+      //Calculation of hat matrix diagonal for next iteration; needed for loglik calculation on augmented dataset
+      PHASE(ws, LF_PH_HAT, hatdiag_pass(fisher_chol, x, xs, xw2, wt, Hdiag, n, k, nthreads, buf));
+      //Calculation of U*:
+      PHASE(ws, LF_PH_SCORE,
+            score_pass(y, weight, pi, Hdiag, *tau, firth, w, n, nthreads);
+            design_XtY(x, xs, w, Ustar, n, k, nthreads, part));
+
       loglik_change = *loglik - loglik_old;
-      
+      if(TRACING(ws)) {
+        trace_iteration(ws, *loglik, maxabsInds(delta, selcol, ncolfit), maxabsInds(Ustar, selcol, ncolfit),
+                        current ? halfs - 1 : *maxhs);
+      }
+
       //Check convergence of main loop:
       if((*iter >= *maxit) || (
-        (maxabsInds(delta, selcol, ncolfit) <= *xconv) && 
+        (maxabsInds(delta, selcol, ncolfit) <= *xconv) &&
           (maxabsInds(Ustar, selcol, ncolfit) < *gconv) &&
           (loglik_change < *lconv))){
         bStop = 1;
@@ -349,28 +615,303 @@ void logistffit_revised(double *x, int *y, int *n_l, int *k_l,
       }
       //Increase iteration counter
       (*iter)++;
-      
+
     } //End of iterations
-    
-    if(ncolfit > 0 && (selcol[0] != -1)) {
-      copy(cov_augmented, fisher_cov, k*k);
+
+    convergence[0] = loglik_change;
+    convergence[1] = maxabsInds(Ustar, selcol, ncolfit);
+    convergence[2] = maxabsInds(delta, selcol, ncolfit);
+  }
+
+  // Covariance matrix: inverse of the last augmented (X^TWX) of the fitted columns,
+  // remapped to k x k; inverse of the full (X^TWX) if only the likelihood was evaluated
+  if(*maxit > 0 && ncolfit > 0 && (selcol[0] != -1)) {
+    PHASE(ws, LF_PH_CHOL, chol_inv(fisher_chol_reduced_augmented, fisher_cov_reduced_augmented, ncolfit));
+    for(i = 0; i < k*k; i++) {
+      fisher_cov[i] = 0.0;
     }
-    
+    for(i=0; i < ncolfit; i++){
+      for(j=0; j < ncolfit; j++) {
+        fisher_cov[selcol[i] + k*selcol[j]] = fisher_cov_reduced_augmented[i + ncolfit*j];
+      }
+    }
+  } else {
+    PHASE(ws, LF_PH_CHOL, chol_inv(fisher_chol, fisher_cov, k));
+  }
+}
+
+
+
+// With the Firth penalty the augmented Fisher information only approximates the Hessian and successive
+// Newton steps shrink geometrically. Returns rho if the step d is about rho times the previous step
+// d_old (0 < rho < 0.9, cosine above 0.9), else 0: the step is then extended by 1 / (1 - rho) to the sum
+// rho^0 + rho^1 + ... of the remaining steps. The callers do not extend twice in a row.
+static double step_ratio(const double *d, const double *d_old, long k)
+{
+  long i;
+  double dd = 0.0, pp = 0.0, ss = 0.0;
+
+  for(i=0; i < k; i++){
+    dd += d[i] * d_old[i];
+    pp += d_old[i] * d_old[i];
+    ss += d[i] * d[i];
+  }
+  return (dd > 0.0 && dd < 0.9 * pp && dd * dd > 0.81 * ss * pp) ? dd / pp : 0.0;
+}
+
+// Trust-region Newton (fit = "TR"): the step is the Newton step of the augmented Fisher information for
+// the fitted columns, scaled to the trust region radius (max norm; initially maxstep). A trial step is
+// accepted if the penalized log-likelihood increases by at least a small fraction of the increase
+// predicted by the quadratic model, which for the scaled step c delta is (c - c^2 / 2) U*^T delta.
+// The radius shrinks after rejected or poorly predicted steps and grows after well predicted steps
+// that were limited by it. Trial steps only evaluate the penalized log-likelihood (evaluate_loglik);
+// evals counts these evaluations. maxhs is not used.
+#define TR_MAXTRIALS 30
+void logistffit_TR_ws(double *x, lf_xstore *xs, int *y, int *n_l, int *k_l,
+                double *weight, double *offset,
+                double *beta,
+                int *colfit, int *ncolfit_l, int *firth_l,
+                int *maxit, double *maxstep, int *maxhs,
+                double *lconv, double *gconv, double *xconv, double* tau, int *threads, int *lowmem,
+                // output:
+                double *fisher_cov,		// k x k
+                double *Ustar,				// k
+                double *pi,						// n
+                double *Hdiag,				// n
+                double *loglik,				// 1
+                int *evals,
+                int *iter,
+                double *convergence, // 3
+                int *warning_prob,
+                lf_arena *ws
+)
+{
+  long n = (long)*n_l, k = (long)*k_l, firth = (long)*firth_l, ncolfit = (long)*ncolfit_l;
+  int nthreads = (*threads > 1) ? *threads : 1;
+  double logdet, loglik_data, loglik_trial = 0.0;
+  long i, j, trial;
+  double loglik_old, loglik_change = 5.0;
+  double radius = (*maxstep >= 0) ? *maxstep : R_PosInf, step, c, e, q, pred, ratio;
+  int bad, status = 0, accepted, extrap = 1;
+  (void) maxhs;	// parameter of the interface common to the fitting engines (see lf_fit_run)
+
+  double *xw2;
+  double *part;
+  double *wt;
+  double *buf;
+  double *fisher_chol;
+  double *beta_old;
+  double *w;
+  double *xw2_reduced_augmented;
+  double *fisher_cov_reduced_augmented;
+  double *fisher_chol_reduced_augmented;
+  double *delta;
+  double *newton;
+  double *delta_old;
+  double *delta_reduced;
+  int *selcol;
+
+  // memory allocations
+  ws_reset(ws);
+  // low-memory mode: no n x k copies of the design, X^TWX and the hat diagonal are streamed from x
+  if(*lowmem || xs != NULL) {
+    xw2 = xw2_reduced_augmented = NULL;
+    if (NULL == (wt = (double *) ws_alloc(ws, n, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+    if (NULL == (buf = (double *) ws_alloc(ws, lowmem_buf(xs, k, nthreads), sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  } else {
+    wt = buf = NULL;
+    if (NULL == (xw2 = (double *) ws_alloc(ws, k * n, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+    if (NULL == (xw2_reduced_augmented = (double *) ws_alloc(ws, n*ncolfit, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  }
+  if (NULL == (part = (double *) ws_alloc(ws, nthreads * k * k, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (fisher_chol = (double *) ws_alloc(ws, k * k, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (beta_old = (double *) ws_alloc(ws, k, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (w = (double *) ws_alloc(ws, n, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (fisher_cov_reduced_augmented = (double *) ws_alloc(ws, ncolfit*ncolfit, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (fisher_chol_reduced_augmented = (double *) ws_alloc(ws, ncolfit*ncolfit, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (delta = (double *) ws_alloc(ws, k, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (newton = (double *) ws_alloc(ws, k, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (delta_old = (double *) ws_alloc(ws, k, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (delta_reduced = (double *) ws_alloc(ws, ncolfit, sizeof(double)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+  if (NULL == (selcol = (int *) ws_alloc(ws, ncolfit, sizeof(int)))){ FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+
+  //Initialise delta:
+  for(i=0; i < k; i++) {
+    delta[i] = newton[i] = delta_old[i] = 0.0;
+  }
+
+  // which columns to select based on the columns to fit:
+  for(i=0; i < ncolfit; i++){
+    selcol[i] = colfit[i] - 1;
+  }
+
+  *evals = 1, *iter = 0, *warning_prob = 0;
+  int bStop = 0;
+
+  // Calculate initial likelihood, hat diagonal and U*
+  bad = evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher_cov, fisher_chol, firth, 1,
+                        &loglik_data, &logdet, n, k, nthreads, part, buf, ws);
+  if(bad == 2) {
+    FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
+  }
+  PHASE(ws, LF_PH_HAT, hatdiag_pass(fisher_chol, x, xs, xw2, wt, Hdiag, n, k, nthreads, buf));
+  *loglik = loglik_data;
+  if(bad){
+    *warning_prob = 1;
+    *loglik = 0.0;
+    bStop = 1;
+  }
+  if(firth){
+    *loglik += *tau * logdet;
+  }
+  PHASE(ws, LF_PH_SCORE,
+        score_pass(y, weight, pi, Hdiag, *tau, firth, w, n, nthreads);
+        design_XtY(x, xs, w, Ustar, n, k, nthreads, part));
+
+  //Start of iteration:
+  if(*maxit > 0 && ncolfit > 0 && (selcol[0] != -1)){ // in case of maxit == 0 only evaluate likelihood
+    for(;;){
+      loglik_old = *loglik;
+      copy(beta, beta_old, k);
+
+      //--Newton step from (X^TWX) using augmented dataset and only columns in selcol
+      PHASE(ws, LF_PH_GRAM,
+            augmented_pass(x, weight, pi, Hdiag, *tau, firth, selcol, ncolfit, xw2_reduced_augmented, wt, n, nthreads);
+            fisher_pass(x, xs, xw2_reduced_augmented, wt, selcol, ncolfit, fisher_cov_reduced_augmented, n, k, nthreads, part, buf));
+      PHASE(ws, LF_PH_CHOL, status = chol_factor(fisher_cov_reduced_augmented, fisher_chol_reduced_augmented, ncolfit));
+      if (status != 0) {
+        FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
+      }
+      if(bStop){
+        // fitted probabilities 0 or 1 at the starting values: no step, the covariance from this factor
+        loglik_change = 0.0;
+        break;
+      }
+      for(i=0; i < ncolfit; i++){
+        delta_reduced[i] = Ustar[selcol[i]];
+      }
+      PHASE(ws, LF_PH_CHOL, chol_solve(fisher_chol_reduced_augmented, delta_reduced, ncolfit, 1));
+      q = 0.0;
+      for(i=0; i < ncolfit; i++){
+        newton[selcol[i]] = delta_reduced[i];
+        q += Ustar[selcol[i]] * delta_reduced[i];   // U*^T (X^TWX)^(-1) U* >= 0
+      }
+      step = maxabs(newton, k);
+
+      //--The first trial of a geometrically shrinking step is extended (see step_ratio)
+      e = 1.0 / (1.0 - (extrap ? 0.0 : step_ratio(newton, delta_old, k)));
+
+      //--Trial steps within the trust region
+      accepted = 0;
+      for(trial = 0; trial < TR_MAXTRIALS && !accepted; trial++) {
+        c = (e * step > radius) ? radius / step : e;
+        if(c < e) {
+          TRACE_COUNT(ws, clips);
+        }
+        for(i=0; i < k; i++){
+          delta[i] = c * newton[i];
+          beta[i] = beta_old[i] + delta[i];
+        }
+        status = evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher_cov, fisher_chol, firth, 1,
+                                 &loglik_data, &logdet, n, k, nthreads, part, buf, ws);
+        if(status == 2) {
+          FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
+        }
+        (*evals)++;
+        loglik_trial = loglik_data + (firth ? *tau * logdet : 0.0);
+
+        // increase predicted by the quadratic model (for extended steps: that of the Newton step)
+        pred = (c > 1.0) ? 0.5 * q : (c - 0.5 * c * c) * q;
+        ratio = (pred > 0.0) ? (loglik_trial - loglik_old) / pred : 0.0;
+        accepted = (status == 0) && (ratio >= 1e-4 || pred <= *lconv * 1e-3);
+        extrap = (c > 1.0);
+        if(c > 1.0){
+          e = 1.0;  // extended step rejected: retry with the Newton step
+        } else if(!accepted || ratio < 0.25){
+          radius = 0.25 * c * step;
+        } else if(ratio > 0.75 && c < 1.0){
+          radius *= 2.0;
+        }
+      }
+
+      if(accepted){
+        *loglik = loglik_trial;
+        copy(delta, delta_old, k);
+        PHASE(ws, LF_PH_HAT, hatdiag_pass(fisher_chol, x, xs, xw2, wt, Hdiag, n, k, nthreads, buf));
+        PHASE(ws, LF_PH_SCORE,
+              score_pass(y, weight, pi, Hdiag, *tau, firth, w, n, nthreads);
+              design_XtY(x, xs, w, Ustar, n, k, nthreads, part));
+      } else {
+        // no acceptable step within TR_MAXTRIALS: stop at beta_old (and restore pi and the hat diagonal)
+        copy(beta_old, beta, k);
+        for(i=0; i < k; i++){
+          delta[i] = 0.0;
+        }
+        status = evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher_cov, fisher_chol, firth, 1,
+                                 &loglik_data, &logdet, n, k, nthreads, part, buf, ws);
+        if(status == 2) {
+          FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
+        }
+        PHASE(ws, LF_PH_HAT, hatdiag_pass(fisher_chol, x, xs, xw2, wt, Hdiag, n, k, nthreads, buf));
+        (*evals)++;
+        if(status == 1){
+          *warning_prob = 1;
+        }
+        bStop = 1;
+      }
+
+      loglik_change = *loglik - loglik_old;
+      if(TRACING(ws)) {
+        trace_iteration(ws, *loglik, maxabsInds(delta, selcol, ncolfit), maxabsInds(Ustar, selcol, ncolfit),
+                        trial - accepted);
+      }
+
+      //Check convergence of main loop:
+      if((*iter >= *maxit) || (
+        (maxabsInds(delta, selcol, ncolfit) <= *xconv) &&
+          (maxabsInds(Ustar, selcol, ncolfit) < *gconv) &&
+          (loglik_change < *lconv))){
+        bStop = 1;
+      }
+      if(bStop){
+        break;
+      }
+      //Increase iteration counter
+      (*iter)++;
+
+    } //End of iterations
+
     convergence[0] = loglik_change;
     convergence[1] = maxabsInds(Ustar, selcol, ncolfit);
     convergence[2] = maxabsInds(delta, selcol, ncolfit);
   }
+
+  // Covariance matrix: inverse of the last augmented (X^TWX) of the fitted columns,
+  // remapped to k x k; inverse of the full (X^TWX) if only the likelihood was evaluated
+  if(*maxit > 0 && ncolfit > 0 && (selcol[0] != -1)) {
+    PHASE(ws, LF_PH_CHOL, chol_inv(fisher_chol_reduced_augmented, fisher_cov_reduced_augmented, ncolfit));
+    for(i = 0; i < k*k; i++) {
+      fisher_cov[i] = 0.0;
+    }
+    for(i=0; i < ncolfit; i++){
+      for(j=0; j < ncolfit; j++) {
+        fisher_cov[selcol[i] + k*selcol[j]] = fisher_cov_reduced_augmented[i + ncolfit*j];
+      }
+    }
+  } else {
+    PHASE(ws, LF_PH_CHOL, chol_inv(fisher_chol, fisher_cov, k));
+  }
 }
 
 
 
-void logistffit_IRLS(double *x, int *y, int *n_l, int *k_l, 
-								double *weight, double *offset, 
+void logistffit_IRLS_ws(double *x, lf_xstore *xs, int *y, int *n_l, int *k_l,
+								double *weight, double *offset,
 								double *beta, // beta is I/O
-								int *colfit, int *ncolfit_l, int *firth_l, 
+								int *colfit, int *ncolfit_l, int *firth_l,
 								int *maxit, double *maxstep, int *maxhs,
-								double *lconv, double *gconv, double *xconv, double* tau, 
-								// output: 
+								double *lconv, double *gconv, double *xconv, double* tau, int *threads, int *lowmem,
+								// output:
 								double *fisher_cov,		// k x k
 								double *pi,						// n
 								double *Hdiag,				// n
@@ -378,242 +919,196 @@ void logistffit_IRLS(double *x, int *y, int *n_l, int *k_l,
 								int *evals,
 								int *iter,
 								double *convergence,		// 3
-								int *warning_prob
+								int *warning_prob,
+								lf_arena *ws
 ){
 	long n = (long)*n_l, k = (long)*k_l, ncolfit = (long)*ncolfit_l, firth = (long)*firth_l;
-	double wi, wi_augmented, logdet;
+	int nthreads = (*threads > 1) ? *threads : 1;
+	double logdet, loglik_data;
 	long i, j;
+	int bad;
+	(void) maxstep, (void) maxhs, (void) gconv;	// parameters of the interface common to the fitting engines (see lf_fit_run)
 	// memory allocations
 
-	double *xt;
 	double *beta_old;
 	double *xw2;
-	double *xw2t;
-	double *tmpNxK;
+	double *part;
+	double *wt;
+	double *buf;
+	double *fisher_chol;
 	int *selcol;
-	double *newresponse; // newresponse of IRLS
+	double *newresponse; // W z, z: newresponse of IRLS
+	double *wa;
+	double *w;
+	double *xwz;
 	double *delta;
 	double *fisher_cov_reduced_augmented;
+	double *fisher_chol_reduced_augmented;
 	double *xw2_reduced_augmented;
-	double *xw2t_reduced_augmented;
-	double *tmp1_reduced;
-	double *covs_full;
-	double *xw2_reduced;
-
-	 if (NULL == (xt = (double *) R_alloc(k * n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (beta_old = (double *) R_alloc(k ,sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (xw2 = (double *) R_alloc(k * n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (xw2t = (double *) R_alloc(n * k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (tmpNxK = (double *) R_alloc(n * k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (selcol = (int *) R_alloc(ncolfit, sizeof(int)))){error("no memory available\n");}
-	 if (NULL == (newresponse = (double *) R_alloc(n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (delta = (double *) R_alloc( k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (fisher_cov_reduced_augmented = (double *) R_alloc(ncolfit* ncolfit, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (xw2_reduced_augmented = (double *) R_alloc(ncolfit* n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (xw2t_reduced_augmented = (double *) R_alloc(ncolfit* n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (tmp1_reduced = (double *) R_alloc(ncolfit* n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (covs_full = (double *) R_alloc(k* k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (xw2_reduced = (double *) R_alloc(ncolfit* n, sizeof(double)))){error("no memory available\n");}
-	
-	
-	trans(x, xt, n, k);
-	
+	double *xwz_reduced;
+
+	 ws_reset(ws);
+	 if (NULL == (beta_old = (double *) ws_alloc(ws, k ,sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 // low-memory mode: no n x k copies of the design, X^TWX and the hat diagonal are streamed from x
+	 if(*lowmem || xs != NULL) {
+	   xw2 = xw2_reduced_augmented = NULL;
+	   if (NULL == (wt = (double *) ws_alloc(ws, n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	   if (NULL == (buf = (double *) ws_alloc(ws, lowmem_buf(xs, k, nthreads), sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 } else {
+	   wt = buf = NULL;
+	   if (NULL == (xw2 = (double *) ws_alloc(ws, k * n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	   if (NULL == (xw2_reduced_augmented = (double *) ws_alloc(ws, ncolfit* n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 }
+	 if (NULL == (part = (double *) ws_alloc(ws, nthreads * k * k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (fisher_chol = (double *) ws_alloc(ws, k * k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (selcol = (int *) ws_alloc(ws, ncolfit, sizeof(int)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (newresponse = (double *) ws_alloc(ws, n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (wa = (double *) ws_alloc(ws, n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (w = (double *) ws_alloc(ws, n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (xwz = (double *) ws_alloc(ws, k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (delta = (double *) ws_alloc(ws,  k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (fisher_cov_reduced_augmented = (double *) ws_alloc(ws, ncolfit* ncolfit, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (fisher_chol_reduced_augmented = (double *) ws_alloc(ws, ncolfit* ncolfit, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (xwz_reduced = (double *) ws_alloc(ws, ncolfit, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+
 	// init loglik
 	double loglik_old, loglik_change = 5.0;
-	
+
 	*evals = 0, *iter = 0, *warning_prob = 0;
 	int bStop = 0;
-	
+
 	//init delta: difference between beta values in iteration i-1 and i
 	//and beta
 	for(i=0; i < k; i++){
 		delta[i] = 0.0;
 	 }
-	
+
 	for(i=0; i < ncolfit; i++){
 	    selcol[i] = colfit[i] - 1;
 	 }
-	
+
 	//Calculate initial likelihood and Hdiag for first iteration:
-	// calculation of pi
-	XtY(xt, beta, pi, k, n, 1);
-	for(i = 0; i < n; i++){
-	  pi[i] = 1.0 / (1.0 + exp( - pi[i] - offset[i]));
-	} 
-	
-	// XW^(1/2)
-	for(i = 0; i < n; i++) {
-	  wi = sqrt(weight[i] * pi[i] * (1.0 - pi[i])); 
-	  for(j = 0; j < k; j++){
-	    xw2[i*k + j] = x[i + j*n] * wi;
-	  }
+	// calculation of pi, XW^(1/2), loglik and the factor of X^TWX
+	bad = evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher_cov, fisher_chol, firth, 1,
+	                      &loglik_data, &logdet, n, k, nthreads, part, buf, ws);
+	if(bad == 2) {
+	    FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
 	}
-	
 	//Calculation of Hat diag:
-	trans(xw2, xw2t, k, n); //W^(1/2)^TX^T
-	XtXasy(xw2t, fisher_cov, n, k); //X^TWX
-	linpack_det(fisher_cov, &k, &logdet);
-    if (logdet < (-200)) {	
-        error("In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
-    }
-    else {
-        linpack_inv(fisher_cov, &k); 
-    }
-	XtY(xw2, fisher_cov, tmpNxK, k, n, k);
-	XYdiag(tmpNxK, xw2, Hdiag, n, k);
-	
+	PHASE(ws, LF_PH_HAT, hatdiag_pass(fisher_chol, x, xs, xw2, wt, Hdiag, n, k, nthreads, buf));
+
 	// Calculation of loglikelihood using augmented dataset if firth:
-	*loglik = 0.0;
 	loglik_old = 0.0;
-	for(i = 0; i < n; i++){ 
-	  if(R_FINITE(log(1.0-pi[i])) && R_FINITE(log(pi[i]))){
-    	      *loglik += y[i] * weight[i] * log(pi[i]) + (1-y[i]) * weight[i] * log(1.0-pi[i]);
-      } else {
-          *warning_prob = 1;
-          *loglik = loglik_old;
-          bStop = 1;
-          break;
-      }
+	*loglik = loglik_data;
+	if(bad){
+	    *warning_prob = 1;
+	    *loglik = loglik_old;
+	    bStop = 1;
 	}
 	if(firth){
-        	    // weight first replication of dataset with h_i * tau 
-            	//*loglik += y[i] * Hdiag[i] * *tau * log(pi[i]) + (1-y[i]) * Hdiag[i] * *tau * log(1-pi[i]);
-            	// weight first replication of dataset with h_i * tau with opponent y
-            	//*loglik += (1-y[i]) * Hdiag[i] * *tau * log(pi[i]) + y[i] * Hdiag[i] * *tau * log(1-pi[i]);
-            	
-            	*loglik += *tau * logdet;
-    }
+	    *loglik += *tau * logdet;
+	}
 	(*evals)++;
-	
-  //Start IRLS: 
+
+  //Start IRLS:
   if(*maxit > 0 && !bStop){
   	for(;;){
       loglik_old = *loglik;
       copy(beta, beta_old, k);
-  
-      XtY(xt, beta_old, newresponse, k, n, 1);
-      for(i=0; i < n; i++){
-          wi = pi[i] * (1.0 - pi[i]) * (weight[i] + 2* *tau * Hdiag[i]); //W
-        if(firth){
-          newresponse[i] += 1/wi*(weight[i] * ((double)y[i]-pi[i]) + 2 * *tau * Hdiag[i] * (0.5 - pi[i]));
-        } else {
-          newresponse[i] += 1/wi*weight[i]*(((double)y[i]-pi[i]));
-        }
-      }
-      
-      // Fisher cov based on augmented dataset and normal X^TW (see iteration formula for beta_new): 
-      for(i = 0; i < n; i++) {
-          if(firth){
-              wi_augmented =  pi[i] * (1.0 - pi[i])* (weight[i] + 2* *tau * Hdiag[i]); 
-          } else {
-              wi_augmented =  pi[i] * (1.0 - pi[i]);
-          }
-        for(j = 0; j < ncolfit; j++){
-          xw2_reduced_augmented[i*ncolfit + j] =  x[i + selcol[j]*n] * sqrt(wi_augmented);
-          xw2_reduced[i*ncolfit + j] = x[i + selcol[j]*n] * wi_augmented;
-        }
+
+      // Fisher cov based on augmented dataset: weights W and rows of X W^(1/2) for the fitted columns
+      PHASE(ws, LF_PH_GRAM,
+            augmented_pass(x, weight, pi, Hdiag, *tau, firth, selcol, ncolfit, xw2_reduced_augmented, wa, n, nthreads));
+
+      // X^TWz with newresponse z = X beta + W^(-1) w, i.e. X^T (W X beta + w) (see iteration formula for beta_new):
+      PHASE(ws, LF_PH_SCORE,
+            score_pass(y, weight, pi, Hdiag, *tau, firth, w, n, nthreads);
+            design_XY(x, xs, beta_old, newresponse, n, k, nthreads);
+            for(i=0; i < n; i++){
+              newresponse[i] = wa[i] * newresponse[i] + w[i];
+            }
+            design_XtY(x, xs, newresponse, xwz, n, k, nthreads, part));
+      for(j = 0; j < ncolfit; j++){
+        xwz_reduced[j] = xwz[selcol[j]];
       }
-      
-      //---- W^(1/2)^T X^T
-      trans(xw2_reduced_augmented, xw2t_reduced_augmented, ncolfit, n); 
-      XtXasy(xw2t_reduced_augmented, fisher_cov_reduced_augmented, n, ncolfit);
-      linpack_det(fisher_cov_reduced_augmented, &ncolfit, &logdet);
-      if (logdet < (-200)) {	
-        error("In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
+
+      //---- X^TWX
+      PHASE(ws, LF_PH_GRAM,
+            fisher_pass(x, xs, xw2_reduced_augmented, wa, selcol, ncolfit, fisher_cov_reduced_augmented, n, k, nthreads, part, buf));
+      PHASE(ws, LF_PH_CHOL,
+            bad = chol_factor(fisher_cov_reduced_augmented, fisher_chol_reduced_augmented, ncolfit) != 0 ||
+                  chol_logdet(fisher_chol_reduced_augmented, ncolfit) < (-200));
+      if (bad) {
+        FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
       }
-      linpack_inv(fisher_cov_reduced_augmented, &ncolfit);
-  
-      	
-      //(-X^TWX)^(-1)X^TW
-    	XY(fisher_cov_reduced_augmented, xw2_reduced, tmp1_reduced, ncolfit, ncolfit, n);
-      	  
-    	double tmp;
+
+      //(X^TWX)^(-1)X^TWz
+      PHASE(ws, LF_PH_CHOL, chol_solve(fisher_chol_reduced_augmented, xwz_reduced, ncolfit, 1));
     	for(j = 0; j < ncolfit; j++) {
-    	   tmp = 0.0;
-    	   for(i = 0; i < n; i++){
-    	       tmp += tmp1_reduced[j + i*ncolfit]*newresponse[i];
-    	   }
-    	   beta[selcol[j]] = tmp;
+    	   beta[selcol[j]] = xwz_reduced[j];
     	}
 
     	//Calculate likelihood and hdiag for next iteration
-    	// calculation of pi
-    	XtY(xt, beta, pi, k, n, 1);
-    	for(i = 0; i < n; i++){
-    	  pi[i] = 1.0 / (1.0 + exp( - pi[i] - offset[i]));
-    	} 
-    	
-    	// XW^(1/2)
-    	for(i = 0; i < n; i++) {
-    	  wi = sqrt(weight[i] * pi[i] * (1.0 - pi[i])); 
-    	  for(j = 0; j < k; j++){
-    	    xw2[i*k + j] = x[i + j*n] * wi;
-    	  }
+    	// calculation of pi, XW^(1/2), loglik and the factor of X^TWX
+    	bad = evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher_cov, fisher_chol, firth, 1,
+    	                      &loglik_data, &logdet, n, k, nthreads, part, buf, ws);
+    	if(bad == 2) {
+    	    FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
     	}
-  
     	//Calculation of Hat diag:
-    	trans(xw2, xw2t, k, n); //W^(1/2)^TX^T
-    	XtXasy(xw2t, fisher_cov, n, k); //X^TWX
-    	linpack_det(fisher_cov, &k, &logdet);
-        if (logdet < (-200)) {	
-            error("In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
-        }
-        linpack_inv(fisher_cov, &k);
-    	
-    	XtY(xw2, fisher_cov, tmpNxK, k, n, k);
-    	XYdiag(tmpNxK, xw2, Hdiag, n, k);
-    	
+    	PHASE(ws, LF_PH_HAT, hatdiag_pass(fisher_chol, x, xs, xw2, wt, Hdiag, n, k, nthreads, buf));
+
     	// Calculation of loglikelihood using augmented dataset if firth:
-    	*loglik = 0.0;
-    	for(i = 0; i < n; i++){ 
-    	   if(R_FINITE(log(1.0-pi[i])) && R_FINITE(log(pi[i]))){
-    	      *loglik += y[i] * weight[i] * log(pi[i]) + (1-y[i]) * weight[i] * log(1.0-pi[i]);
-    	   } else {
-    	       *warning_prob = 1;
-    	       *loglik = loglik_old;
-    	       bStop = 1;
-    	       break;
-    	   }
+    	*loglik = loglik_data;
+    	if(bad){
+    	    *warning_prob = 1;
+    	    *loglik = loglik_old;
+    	    bStop = 1;
     	}
     	if(firth){
-        	    // weight first replication of dataset with h_i * tau 
-            	//*loglik += y[i] * Hdiag[i] * *tau * log(pi[i]) + (1-y[i]) * Hdiag[i] * *tau * log(1-pi[i]);
-            	// weight first replication of dataset with h_i * tau with opponent y
-            	//*loglik += (1-y[i]) * Hdiag[i] * *tau * log(pi[i]) + y[i] * Hdiag[i] * *tau * log(1-pi[i]);
-            	    
-            	*loglik += *tau * logdet;
-        }
+    	    *loglik += *tau * logdet;
+    	}
     	(*evals)++;
-    	
+
     	loglik_change = *loglik - loglik_old;
     	for(i=0; i < k; i++){
     		delta[i] = beta[i]-beta_old[i];
     	}
     	(*iter)++;
-      		
+    	// the trace records max |U*| at the new beta, which IRLS itself does not need
+    	if(TRACING(ws)) {
+    	    PHASE(ws, LF_PH_SCORE,
+    	          score_pass(y, weight, pi, Hdiag, *tau, firth, w, n, nthreads);
+    	          design_XtY(x, xs, w, xwz, n, k, nthreads, part));
+    	    trace_iteration(ws, *loglik, maxabsInds(delta, selcol, ncolfit), maxabsInds(xwz, selcol, ncolfit), 0);
+    	}
+
     	if((*iter >= *maxit) || ((maxabsInds(delta, selcol, ncolfit) <= *xconv) && (loglik_change < *lconv)) ) {
     	    bStop = 1;
     	}
-      		
+
     	if(bStop){
     		break;
     	}
     }
 }
 
-	
+
 	// return adjusted vcov matrix if not all variables were fitted:
-	for(i = 0; i < k*k; i++) {
-	  covs_full[i] = 0.0; // init 0
-	}
-	if(*maxit > 0){
+	if(*iter > 0){
+      	PHASE(ws, LF_PH_CHOL, chol_inv(fisher_chol_reduced_augmented, fisher_cov_reduced_augmented, ncolfit));
+      	for(i = 0; i < k*k; i++) {
+      	  fisher_cov[i] = 0.0; // init 0
+      	}
       	for(i=0; i < ncolfit; i++){
       	  for(j=0; j < ncolfit; j++) {
-      	    covs_full[selcol[i] + k*selcol[j]] = fisher_cov_reduced_augmented[i + ncolfit*j];
-      	  }   
+      	    fisher_cov[selcol[i] + k*selcol[j]] = fisher_cov_reduced_augmented[i + ncolfit*j];
+      	  }
       	}
-      	copy(covs_full, fisher_cov, k*k);
-      	
+	} else {
+		PHASE(ws, LF_PH_CHOL, chol_inv(fisher_chol, fisher_cov, k));
+	}
+	if(*maxit > 0){
       	convergence[0] = loglik_change;
       	convergence[2] = maxabsInds(delta, selcol, ncolfit);
 	}
@@ -621,288 +1116,327 @@ void logistffit_IRLS(double *x, int *y, int *n_l, int *k_l,
 
 
 
+// Accelerated start of a profile likelihood limit search from the maximum beta: d = lambda (X^TWX)^(-1) e_i
+// is the step to the Wald limit, which also moves the other parameters to their linearized conditional
+// maximum. Along beta + t d the log-likelihood is fitted by l(t) = l(0) - c t^2 through l(0) and the last
+// evaluation, and t is moved to where this quadratic reaches LL0 (secant steps on t^2, at most 4-fold).
+// beta is moved to the evaluated point closest to LL0; it is left unchanged if no evaluation succeeds.
+#define PL_SEED_EVALS 4
+static void pl_seed(double *x, lf_xstore *xs, int *y, double *weight, double *offset, double *beta, double *d, double *b,
+                    double *pi, double *xw2, double *wt, double *fisher, double *fisher_chol, long iSel, int which,
+                    double LL0, double tau, long firth, long n, long k, int nthreads, double *part, double *buf,
+                    lf_arena *ws)
+{
+  double lmax, l, lbest, t = 1.0, tbest = 0.0, v, c, logdet;
+  long i, e;
+
+  if(evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher, fisher_chol, firth, 1,
+                     &lmax, &logdet, n, k, nthreads, part, buf, ws) != 0 || (lmax += tau * logdet) <= LL0)
+    return;
+  for(i = 0; i < k; i++)
+    d[i] = 0.0;
+  d[iSel] = 1.0;
+  PHASE(ws, LF_PH_CHOL, chol_solve(fisher_chol, d, k, 1));
+  if((v = d[iSel]) <= 0.0)
+    return;
+  v = which * sqrt(2.0 * (lmax - LL0) / v);
+  for(i = 0; i < k; i++)
+    d[i] *= v;
+  lbest = lmax;
+  for(e = 0; e < PL_SEED_EVALS; e++) {
+    for(i = 0; i < k; i++)
+      b[i] = beta[i] + t * d[i];
+    if(evaluate_loglik(x, xs, y, weight, offset, b, pi, xw2, wt, fisher, fisher_chol, firth, 0,
+                       &l, &logdet, n, k, nthreads, part, buf, ws) != 0 || (l += tau * logdet) >= lmax) {
+      t /= 2.0;
+      continue;
+    }
+    if(fabs(l - LL0) < fabs(lbest - LL0)) {
+      lbest = l;
+      tbest = t;
+    }
+    if(fabs(l - LL0) <= 0.05 * (lmax - LL0))
+      break;
+    c = (lmax - l) / (t * t);
+    t = fmin(sqrt((lmax - LL0) / c), 4.0 * t);
+  }
+  for(i = 0; i < k; i++)
+    beta[i] += tbest * d[i];
+}
+
 // profile likelihood
-void logistplfit(double *x, int *y, int *n_l, int *k_l, 
-							double *weight, double *offset, 
+void logistplfit_ws(double *x, lf_xstore *xs, int *y, int *n_l, int *k_l,
+							double *weight, double *offset,
 							double *beta, // beta is I/O (init)
-							int *iSel, int *which, double *LL0, int *firth_l, 
+							int *iSel, int *which, double *LL0, int *firth_l,
 							// control parameter:
 							int *maxit, double *maxstep, int *maxhs,
-							double *lconv, double *xconv, double *tau,
-							// output: 
+							double *lconv, double *xconv, double *tau, int *lowmem, int *accel,
+							// output:
 							double *betahist,			// k * maxit
 							double *loglik,				// 1
-							int *iter,						// 1 
+							int *iter,						// 1
 							double *convergence,		// 2
-							int *warning_prob
+							int *warning_prob,
+							lf_arena *ws
 							)
 {
 	long n = (long)*n_l, k = (long)*k_l, firth = (long)*firth_l;
-	double wi, logdet;
-	long i, j, halfs;
-	double loglik_old, lambda, mx, wi_augmented;
-	
+	int nthreads = 1;
+	double logdet, loglik_data;
+	long i, halfs;
+	double loglik_old, lambda, mx, quad, rho;
+	int bad, status, extrap = 1;
+
 	int bStop = 0;
-	
+
 	// memory allocations
-	double *xt;
 	double *beta_old;
 	double *xw2;
-	double *xw2t;
+	double *part;
+	double *wt;
+	double *buf;
 	double *xw2_augmented;
-	double *xw2t_augmented;
-	double *tmpNxK;
 	double *w;
-	double *tmpKx1;
-	double *Vinv;
-	double *cov;
-	double *tmp1x1;
+	double *e_sel;
 	double *delta;
-	double *XBeta;	
+	double *delta_old;
 	double *fisher;
+	double *fisher_chol;
 	double *fisher_augmented;
+	double *fisher_chol_augmented;
 	double *Ustar;
 	double *pi;
 	double *Hdiag;
 
-	 if (NULL == (xt = (double *) R_alloc(k * n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (beta_old = (double *) R_alloc(k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (xw2 = (double *) R_alloc(k * n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (xw2t = (double *) R_alloc(k * n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (xw2_augmented = (double *) R_alloc(k * n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (xw2t_augmented = (double *) R_alloc(k * n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (tmpNxK = (double *) R_alloc(k * n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (w = (double *) R_alloc(n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (tmpKx1 = (double *) R_alloc(k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (Vinv = (double *) R_alloc(k * k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (cov = (double *) R_alloc(k * k,sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (tmp1x1 = (double *) R_alloc(1, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (delta = (double *) R_alloc(k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (XBeta = (double *) R_alloc(n, sizeof(double)))){error("no memory available\n");}	
-	 if (NULL == (fisher = (double *) R_alloc(k * k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (fisher_augmented = (double *) R_alloc(k * k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (Ustar = (double *) R_alloc(k, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (pi = (double *) R_alloc(n, sizeof(double)))){error("no memory available\n");}
-	 if (NULL == (Hdiag = (double *) R_alloc(n, sizeof(double)))){error("no memory available\n");}
-	
+	 ws_reset(ws);
+	 if (NULL == (beta_old = (double *) ws_alloc(ws, k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 // low-memory mode: no n x k copies of the design, X^TWX and the hat diagonal are streamed from x
+	 if(*lowmem || xs != NULL) {
+	   xw2 = xw2_augmented = NULL;
+	   if (NULL == (wt = (double *) ws_alloc(ws, n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	   if (NULL == (buf = (double *) ws_alloc(ws, lowmem_buf(xs, k, nthreads), sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 } else {
+	   wt = buf = NULL;
+	   if (NULL == (xw2 = (double *) ws_alloc(ws, k * n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	   if (NULL == (xw2_augmented = (double *) ws_alloc(ws, k * n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 }
+	 if (NULL == (part = (double *) ws_alloc(ws, nthreads * k * k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (w = (double *) ws_alloc(ws, n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (e_sel = (double *) ws_alloc(ws, k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (delta = (double *) ws_alloc(ws, k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (delta_old = (double *) ws_alloc(ws, k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (fisher = (double *) ws_alloc(ws, k * k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (fisher_chol = (double *) ws_alloc(ws, k * k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (fisher_augmented = (double *) ws_alloc(ws, k * k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (fisher_chol_augmented = (double *) ws_alloc(ws, k * k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (Ustar = (double *) ws_alloc(ws, k, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (pi = (double *) ws_alloc(ws, n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+	 if (NULL == (Hdiag = (double *) ws_alloc(ws, n, sizeof(double)))){FIT_ERROR(ws, LF_NOMEM, "no memory available\n");}
+
 	*warning_prob = 0;
-	
-	// init pi
-	trans(x, xt, n, k);
+	// no previous step before the first iteration (accelerated mode)
+	for(i=0; i < k; i++){
+	    delta_old[i] = 0.0;
+	}
+
+	// accelerated mode: start from the extrapolated limit instead of the maximum
+	if(*accel)
+	    pl_seed(x, xs, y, weight, offset, beta, delta, beta_old, pi, xw2, wt, fisher, fisher_chol, (*iSel) - 1, *which,
+	            *LL0, *tau, firth, n, k, nthreads, part, buf, ws);
+
 	//Calculate initial likelihood and Hdiag for first iteration:
-	// calculation of pi
-	XtY(xt, beta, pi, k, n, 1);
-	for(i = 0; i < n; i++){
-	  pi[i] = 1.0 / (1.0 + exp( - pi[i] - offset[i]));
-	} 
-	
-	// XW^(1/2)
-	for(i = 0; i < n; i++) {
-	  wi = sqrt(weight[i] * pi[i] * (1.0 - pi[i])); 
-	  for(j = 0; j < k; j++){
-	    xw2[i*k + j] = x[i + j*n] * wi;
-	  }
+	// calculation of pi, XW^(1/2), loglik and the factor of X^TWX
+	bad = evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher, fisher_chol, firth, 1,
+	                      &loglik_data, &logdet, n, k, nthreads, part, buf, ws);
+	if(bad == 2) {
+	    FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
 	}
-	
 	//Calculation of Hat diag:
-	trans(xw2, xw2t, k, n); //W^(1/2)^TX^T
-	XtXasy(xw2t, fisher, n, k); //X^TWX
-	linpack_det(fisher, &k, &logdet);
-    if (logdet < (-200)) {	
-        error("In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
-    } else {
-        linpack_inv(fisher, &k); 
-    }
-	XtY(xw2, fisher, tmpNxK, k, n, k);
-	XYdiag(tmpNxK, xw2, Hdiag, n, k);
-	
+	PHASE(ws, LF_PH_HAT, hatdiag_pass(fisher_chol, x, xs, xw2, wt, Hdiag, n, k, nthreads, buf));
+
 	// Calculation of loglikelihood using augmented dataset if firth:
-	*loglik = 0.0;
 	loglik_old = 0.0;
-	for(i = 0; i < n; i++){ 
-	  if(R_FINITE(log(1.0-pi[i])) && R_FINITE(log(pi[i]))){
-    	      *loglik += y[i] * weight[i] * log(pi[i]) + (1-y[i]) * weight[i] * log(1.0-pi[i]);
-      } else {
-          *warning_prob = 1;
-          *loglik = loglik_old;
-          break;
-      }
+	*loglik = loglik_data;
+	if(bad){
+	    *warning_prob = 1;
+	    *loglik = loglik_old;
 	}
 	if(firth){
-        	    // weight first replication of dataset with h_i * tau 
-            	//*loglik += y[i] * Hdiag[i] * *tau * log(pi[i]) + (1-y[i]) * Hdiag[i] * *tau * log(1-pi[i]);
-            	// weight first replication of dataset with h_i * tau with opponent y
-            	//*loglik += (1-y[i]) * Hdiag[i] * *tau * log(pi[i]) + y[i] * Hdiag[i] * *tau * log(1-pi[i]);
-            	    
-                *loglik += *tau * logdet;
-    }
-	
-	// Fisher cov based on augmented dataset and normal X^TW (see iteration formula for beta_new): 
-    for(i = 0; i < n; i++) {
-        if(firth){
-            wi_augmented =  pi[i] * (1.0 - pi[i])* (weight[i] + 2 * *tau * Hdiag[i]); 
-        } else {
-            wi_augmented = weight[i] * pi[i] * (1.0-pi[i]);
-        }
-        for(j = 0; j < k; j++){
-            xw2_augmented[i*k + j] =  x[i + j*n] * sqrt(wi_augmented);
-        }
-    }
-      
-    //---- W^(1/2)^T X^T
-    trans(xw2_augmented, xw2t_augmented, k, n);
-	XtXasy(xw2t_augmented, fisher_augmented, n, k);
-    linpack_det(fisher_augmented, &k, &logdet);
-    if (logdet < (-200)) {	
-        error("In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
+	    *loglik += *tau * logdet;
+	}
+
+	// Fisher cov based on augmented dataset and normal X^TW (see iteration formula for beta_new):
+	PHASE(ws, LF_PH_GRAM,
+	      augmented_pass(x, weight, pi, Hdiag, *tau, firth, NULL, k, xw2_augmented, wt, n, nthreads);
+	      fisher_pass(x, xs, xw2_augmented, wt, NULL, k, fisher_augmented, n, k, nthreads, part, buf));
+	PHASE(ws, LF_PH_CHOL,
+	      status = chol_factor(fisher_augmented, fisher_chol_augmented, k) != 0 ||
+	               chol_logdet(fisher_chol_augmented, k) < (-200));
+    if (status) {
+        FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
     }
-    linpack_inv(fisher_augmented, &k);
 
 	*iter = 0;
 	for(;;) {
 		//Calculation of U*:
-        if(firth){
-          for(i=0; i < n; i++){
-            w[i] = weight[i] * ((double)y[i]-pi[i]) + 2 * *tau * Hdiag[i] * (0.5 - pi[i]);
-          }
-        } else {
-          for(i=0; i < n; i++){
-            w[i] = weight[i] * ((double)y[i] - pi[i]);
-          }
-        }
-        XtY(x, w, Ustar, n, k, 1);
-		
-		//Mulitplication of U*IU*:  
-		for(i=0; i<(k*k); i++){
-		    fisher[i] = -fisher_augmented[i];
+		PHASE(ws, LF_PH_SCORE,
+		      score_pass(y, weight, pi, Hdiag, *tau, firth, w, n, nthreads);
+		      design_XtY(x, xs, w, Ustar, n, k, nthreads, part));
+
+		// (X^TWX)^(-1) U* and the column of (X^TWX)^(-1) belonging to the selected variable:
+		copy(Ustar, delta, k);
+		for(i=0; i < k; i++){
+		    e_sel[i] = 0.0;
 		}
-		
-		XtY(Ustar, fisher, tmpKx1, k, 1, k); 
-		XtY(tmpKx1, Ustar, tmp1x1, k, 1, 1); //U*^T (X^TWX)^(-1) u*
-		
-		double underRoot = (-2.0) *((*LL0 - *loglik) + 0.5*tmp1x1[0]) / fisher_augmented[k*((*iSel)-1) + (*iSel)-1]; 
-		lambda = (underRoot < 0.0) ? 0.0 : (double)(*which) * sqrt(underRoot); 
-		
-		//add lambda to r-th entry in U*: 
-		Ustar[(*iSel)-1] += lambda;
-
-		XtY(fisher_augmented, Ustar, delta, k, k, 1);
-        
+		e_sel[(*iSel)-1] = 1.0;
+		PHASE(ws, LF_PH_CHOL,
+		      chol_solve(fisher_chol_augmented, delta, k, 1);
+		      chol_solve(fisher_chol_augmented, e_sel, k, 1));
+
+		//Mulitplication of U*IU*:
+		quad = 0.0;
+		for(i=0; i < k; i++){
+		    quad += Ustar[i] * delta[i]; //U*^T (X^TWX)^(-1) u*
+		}
+
+		double underRoot = (-2.0) *((*LL0 - *loglik) - 0.5*quad) / e_sel[(*iSel)-1];
+		lambda = (underRoot < 0.0) ? 0.0 : (double)(*which) * sqrt(underRoot);
+
+		//add lambda to r-th entry in U*:
+		for(i=0; i < k; i++){
+		    delta[i] += lambda * e_sel[i];
+		}
+
+		// accelerated mode: a geometrically shrinking step is extended (see step_ratio)
+		if(*accel) {
+		    rho = extrap ? 0.0 : step_ratio(delta, delta_old, k);
+		    for(i=0; i < k && rho > 0.0; i++){
+		        delta[i] /= 1.0 - rho;
+		    }
+		    extrap = (rho > 0.0);
+		}
+
         if(*maxstep >= 0){
             mx = maxabs(delta, k) / *maxstep;
     		if(mx > 1.0) {
+    		    TRACE_COUNT(ws, clips);
     		    for(i=0; i < k; i++){
     		        delta[i] /= mx;
     		    }
     		}
         }
-		
+
 		for(i=0; i < k; i++){
 		    beta[i] += delta[i];
 		}
-		
+
 		loglik_old = *loglik;
-		
+
+		// step-halving: the trial steps only evaluate the penalized loglik, the hat diagonal and the augmented
+		// X^TWX are computed once for the accepted beta
 		for(halfs = 0;;) {
-			// calculation of pi
-        	XtY(xt, beta, pi, k, n, 1);
-        	for(i = 0; i < n; i++){
-        	  pi[i] = 1.0 / (1.0 + exp( - pi[i] - offset[i]));
-        	} 
-        	
-        	// XW^(1/2)
-        	for(i = 0; i < n; i++) {
-        	  wi = sqrt(weight[i] * pi[i] * (1.0 - pi[i])); 
-        	  for(j = 0; j < k; j++){
-        	    xw2[i*k + j] = x[i + j*n] * wi;
-        	  }
-        	}
-        	//Calculation of Hat diag:
-        	trans(xw2, xw2t, k, n); //W^(1/2)^TX^T
-        	XtXasy(xw2t, fisher, n, k); //X^TWX
-        	linpack_det(fisher, &k, &logdet);
-            if (logdet < (-200)) {
-                error("In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
-            }
-            else {
-                linpack_inv(fisher, &k); 
-            }
-        	XtY(xw2, fisher, tmpNxK, k, n, k);
-        	XYdiag(tmpNxK, xw2, Hdiag, n, k);
-        	
+			// calculation of pi, XW^(1/2), loglik and the factor of X^TWX
+			status = evaluate_loglik(x, xs, y, weight, offset, beta, pi, xw2, wt, fisher, fisher_chol, firth, 1,
+			                         &loglik_data, &logdet, n, k, nthreads, part, buf, ws);
+			if (status == 2) {
+			    FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
+			}
+
 			// Calculation of loglikelihood using augmented dataset if firth:
-        	*loglik = 0.0;
-        	for(i = 0; i < n; i++){ 
-        	  if(R_FINITE(log(1.0-pi[i])) && R_FINITE(log(pi[i]))){
-            	      *loglik += y[i] * weight[i] * log(pi[i]) + (1.0-y[i]) * weight[i] * log(1.0-pi[i]);
-              } else {
-                  *warning_prob = 1;
-                  bStop = 1;
-                  *loglik = loglik_old;
-                  break;
-              }
+        	*loglik = loglik_data;
+        	if(status == 1){
+        	    *warning_prob = 1;
+        	    bStop = 1;
+        	    *loglik = loglik_old;
         	}
         	if(firth){
-                	    // weight first replication of dataset with h_i * tau 
-            	        //*loglik += y[i] * Hdiag[i] * *tau * log(pi[i]) + (1-y[i]) * Hdiag[i] * *tau * log(1-pi[i]);
-            	        // weight first replication of dataset with h_i * tau with opponent y
-            	        //*loglik += (1-y[i]) * Hdiag[i] * *tau * log(pi[i]) + y[i] * Hdiag[i] * *tau * log(1-pi[i]);
-            	    
-            	       *loglik += *tau * logdet;
-            }
-        	
-        	if(bStop){
-        	    break;
-        	 }
-        	
-        	// Fisher cov based on augmented dataset if firth
-            for(i = 0; i < n; i++) {
-                if(firth){
-                    wi_augmented =  pi[i] * (1.0 - pi[i])* (weight[i] + 2 * *tau * Hdiag[i]); 
-                } else {
-                    wi_augmented = weight[i] * pi[i] * (1.0-pi[i]);
-                    }
-                for(j = 0; j < k; j++){
-                    xw2_augmented[i*k + j] =  x[i + j*n] * sqrt(wi_augmented);
-                }
-            }
-              
-            //---- W^(1/2)^T X^T
-            trans(xw2_augmented, xw2t_augmented, k, n);
-        	XtXasy(xw2t_augmented, fisher_augmented, n, k);
-            linpack_det(fisher_augmented, &k, &logdet);
-            if (logdet < (-200)) {	
-                error("In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
-            }
-            linpack_inv(fisher_augmented, &k);
-        	
+        	    *loglik += *tau * logdet;
+        	}
+
         	halfs++;
-			
-			if((halfs >= *maxhs) || ((fabs(*loglik - *LL0) < fabs(loglik_old - *LL0)) && (*loglik > *LL0)))
-				break; 
-			
+
+			if(bStop || (halfs >= *maxhs) || ((fabs(*loglik - *LL0) < fabs(loglik_old - *LL0)) && (*loglik > *LL0)))
+				break;
+
 			for(i=0; i < k; i++) {
 				delta[i] /= 2.0;
 				beta[i] -= delta[i];
 			}
 		}
-		
+
+		//Calculation of Hat diag:
+		PHASE(ws, LF_PH_HAT, hatdiag_pass(fisher_chol, x, xs, xw2, wt, Hdiag, n, k, nthreads, buf));
+
+		// Fisher cov based on augmented dataset if firth
+		if(!bStop){
+		    PHASE(ws, LF_PH_GRAM,
+		          augmented_pass(x, weight, pi, Hdiag, *tau, firth, NULL, k, xw2_augmented, wt, n, nthreads);
+		          fisher_pass(x, xs, xw2_augmented, wt, NULL, k, fisher_augmented, n, k, nthreads, part, buf));
+		    PHASE(ws, LF_PH_CHOL,
+		          status = chol_factor(fisher_augmented, fisher_chol_augmented, k) != 0 ||
+		                   chol_logdet(fisher_chol_augmented, k) < (-200));
+		    if (status) {
+		        FIT_ERROR(ws, LF_SINGULAR, "In iteration %d: Determinant of Fisher information matrix was numerically 0", *iter);
+		    }
+		}
+
 		(*iter)++;
-		
+		copy(delta, delta_old, k);
+		if(TRACING(ws)) {
+		    trace_iteration(ws, *loglik, maxabs(delta, k), maxabs(Ustar, k), halfs - 1);
+		}
+
 		for(i=0; i < k; i++){
 		    betahist[i * (*maxit) + (*iter) - 1] = beta[i];
 		}
-		
+
 		if((*iter >= *maxit) || ((fabs(*loglik - *LL0) <= *lconv) && (maxabs(delta, k) < *xconv))){
 		    break;
 		}
 	}
-	
+
 	convergence[0] = fabs(*loglik - *LL0);
 	convergence[1] = maxabs(delta, k);
 }
 
 
 
+#ifndef LOGISTF_STANDALONE
+// .C entry points: workspace allocated by R_alloc
+
+void logistffit_revised(double *x, int *y, int *n_l, int *k_l, double *weight, double *offset,
+                double *beta, int *colfit, int *ncolfit_l, int *firth_l,
+                int *maxit, double *maxstep, int *maxhs, double *lconv, double *gconv, double *xconv,
+                double *tau, int *threads, int *lowmem,
+                double *fisher_cov, double *Ustar, double *pi, double *Hdiag, double *loglik,
+                int *evals, int *iter, double *convergence, int *warning_prob)
+{
+  logistffit_revised_ws(x, NULL, y, n_l, k_l, weight, offset, beta, colfit, ncolfit_l, firth_l,
+                        maxit, maxstep, maxhs, lconv, gconv, xconv, tau, threads, lowmem,
+                        fisher_cov, Ustar, pi, Hdiag, loglik, evals, iter, convergence, warning_prob, NULL);
+}
 
+void logistffit_IRLS(double *x, int *y, int *n_l, int *k_l, double *weight, double *offset,
+                double *beta, int *colfit, int *ncolfit_l, int *firth_l,
+                int *maxit, double *maxstep, int *maxhs, double *lconv, double *gconv, double *xconv,
+                double *tau, int *threads, int *lowmem,
+                double *fisher_cov, double *pi, double *Hdiag, double *loglik,
+                int *evals, int *iter, double *convergence, int *warning_prob)
+{
+  logistffit_IRLS_ws(x, NULL, y, n_l, k_l, weight, offset, beta, colfit, ncolfit_l, firth_l,
+                     maxit, maxstep, maxhs, lconv, gconv, xconv, tau, threads, lowmem,
+                     fisher_cov, pi, Hdiag, loglik, evals, iter, convergence, warning_prob, NULL);
+}
 
+void logistplfit(double *x, int *y, int *n_l, int *k_l, double *weight, double *offset,
+                double *beta, int *iSel, int *which, double *LL0, int *firth_l,
+                int *maxit, double *maxstep, int *maxhs, double *lconv, double *xconv, double *tau, int *lowmem,
+                double *betahist, double *loglik, int *iter, double *convergence, int *warning_prob)
+{
+  int accel = 0;
+  logistplfit_ws(x, NULL, y, n_l, k_l, weight, offset, beta, iSel, which, LL0, firth_l,
+                 maxit, maxstep, maxhs, lconv, xconv, tau, lowmem, &accel,
+                 betahist, loglik, iter, convergence, warning_prob, NULL);
+}
+#endif
@@ -0,0 +1,151 @@
+#ifndef ___LOGISTF_H
+#define ___LOGISTF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Allocator of the memory of an arena: alloc returns NULL on failure; ctx is passed through
+typedef struct {
+	void *(*alloc)(size_t size, void *ctx);
+	void (*free)(void *p, void *ctx);
+	void *ctx;
+} lf_allocator;
+
+// Instrumentation of a fit (logistf.control(trace = TRUE)): seconds per phase by a monotonic clock,
+// counters, and per pass through the iteration loop the penalized log-likelihood, max |delta| and max |U*|
+// of the fitted columns (for logistplfit: U* at the start of the iteration) and the number of halvings
+#define LF_PH_LIK	0	// linear predictor, fitted probabilities and log-likelihood
+#define LF_PH_GRAM	1	// X^TWX and the augmented X^TWX
+#define LF_PH_CHOL	2	// Cholesky factorizations, log-determinants, solves and inverses
+#define LF_PH_HAT	3	// hat diagonal
+#define LF_PH_SCORE	4	// score U* (IRLS: X^TWz)
+#define LF_NPHASE	5
+
+typedef struct {
+	double time[LF_NPHASE];
+	double total;		// seconds of the whole fit, measured by the caller
+	int halvings;		// step halvings (logistffit_revised, logistplfit), rejected trial steps (logistffit_TR)
+	int clips;			// steps shortened to maxstep (logistffit_TR: to the trust region radius)
+	int maxiter;		// capacity of the per-iteration arrays
+	int niter;			// passes through the iteration loop (entries beyond maxiter are not stored)
+	double *loglik, *delta, *score;
+	int *halfs;
+} lf_trace;
+
+// Workspace arena of the fitting routines (see ws_alloc in logistf.c)
+typedef struct {
+	char *base;
+	size_t size;		// capacity in bytes
+	size_t used;		// bytes handed out in the current call
+	size_t need;		// bytes requested in the current call
+	int collect;		// collect mode: report errors in status instead of raising them
+	int status;			// LF_OK or the error of the last call in collect mode
+	const lf_allocator *allocator;	// grows the arena (ws_reserve); NULL: malloc / free
+	lf_trace *trace;				// instrumentation of the fits on this arena; NULL: off
+} lf_arena;
+
+#define LF_OK		0
+#define LF_NOMEM	1	// arena too small (collect mode) or allocation failed
+#define LF_SINGULAR	2	// Fisher information matrix numerically singular
+#define LF_INVALID	3	// invalid arguments (standalone library)
+
+// Alternative storage of the design matrix (see logistf_call.c):
+// LF_XSPARSE  compressed rows (from a dgCMatrix): the nonzeros of row i are val[rowptr[i]..rowptr[i+1]-1]
+//             in the columns col[rowptr[i]..rowptr[i+1]-1], in ascending order
+// LF_XFLOAT   x (n x k, column-major) in single precision in xf; all sums are accumulated in double
+// LF_XMIXED   0/1 columns bit-packed, the others in double: column j is column cidx[j] of the n x nd matrix
+//             xd if cidx[j] >= 0 and column -cidx[j]-1 of bits otherwise, whose (n+63)/64 words per column
+//             hold row i in bit i%64 of word i/64 (unused bits 0)
+typedef struct {
+	int type;
+	int *rowptr;
+	int *col;
+	double *val;
+	float *xf;
+	uint64_t *bits;
+	double *xd;
+	int *cidx;
+} lf_xstore;
+
+#define LF_XSPARSE	1
+#define LF_XFLOAT	2
+#define LF_XMIXED	3
+
+void ws_reset(lf_arena *ws);
+void *ws_alloc(lf_arena *ws, size_t count, size_t size);
+int ws_reserve(lf_arena *ws);
+void ws_free(lf_arena *ws);
+
+// Plain C interface of the fitting core (logistf_lib.c), also built without R as the standalone library
+// (see standalone/Makefile). Pointers are borrowed from the caller: nothing is copied or kept.
+
+// Data: x is n x k column-major, or NULL with an alternative storage xs; y is 0/1
+typedef struct {
+	int n, k;
+	double *x;
+	lf_xstore *xs;
+	int *y;
+	double *weight, *offset;
+} lf_problem;
+
+#define LF_NR		0	// Newton-Raphson with step halving (logistffit_revised)
+#define LF_IRLS		1	// iteratively reweighted least squares (logistffit_IRLS)
+#define LF_TR		2	// trust-region Newton (logistffit_TR)
+
+// Settings of a fit, as in logistf.control() / logistpl.control(); lf_control_init sets their defaults
+typedef struct {
+	int method, firth, maxit, maxhs, threads, lowmem;
+	double maxstep, lconv, gconv, xconv, tau;
+} lf_control;
+
+// Results of a fit: beta holds the starting values on entry; var (k x k), pi and hdiag (n) are required,
+// score (k, the penalized score of the fitted columns) may be NULL
+typedef struct {
+	double *beta, *var, *score, *pi, *hdiag;
+	double loglik, conv[3];
+	int iter, evals, warning_prob;
+} lf_fit;
+
+void lf_control_init(lf_control *ctl);
+void lf_arena_init(lf_arena *ws, const lf_allocator *allocator);
+const char *lf_strerror(int code);
+// Clears the times and counters of a trace (its arrays are kept); lf_fit_model and lf_profile_limit clear
+// the trace of ws before the fit and measure its total time
+void lf_trace_reset(lf_trace *tr);
+
+// Fits the columns colfit (1-based, NULL: all k) and returns LF_OK or an error code. The workspace is
+// taken from ws, which grows as needed and is kept for the next fit (release it by ws_free); ws = NULL
+// uses a temporary arena with malloc / free.
+int lf_fit_model(const lf_problem *p, const int *colfit, int ncolfit, const lf_control *ctl, lf_fit *fit,
+	lf_arena *ws);
+// Profile likelihood limit of variable i (1-based): the lower (which = -1) or upper (which = 1) limit at
+// which the log-likelihood drops to LL0; beta holds the maximum on entry and the limit on exit
+int lf_profile_limit(const lf_problem *p, int i, int which, double LL0, const lf_control *ctl, int accel,
+	double *beta, double *loglik, int *iter, double *conv, int *warning_prob, lf_arena *ws);
+
+// Dispatch of a fit to the routine of ctl->method in the calling mode of ws (shared with logistf_call.c)
+void lf_fit_run(const lf_problem *p, int *colfit, int ncolfit, const lf_control *ctl, lf_fit *fit, lf_arena *ws);
+
+// Fitting routines; ws = NULL allocates the workspace by R_alloc.
+// With an alternative storage xs of the design (x is then not used) the routines run in low-memory mode.
+void logistffit_revised_ws(double *x, lf_xstore *xs, int *y, int *n_l, int *k_l, double *weight, double *offset,
+	double *beta, int *colfit, int *ncolfit_l, int *firth_l, int *maxit, double *maxstep, int *maxhs,
+	double *lconv, double *gconv, double *xconv, double *tau, int *threads, int *lowmem,
+	double *fisher_cov, double *Ustar, double *pi, double *Hdiag, double *loglik,
+	int *evals, int *iter, double *convergence, int *warning_prob, lf_arena *ws);
+void logistffit_TR_ws(double *x, lf_xstore *xs, int *y, int *n_l, int *k_l, double *weight, double *offset,
+	double *beta, int *colfit, int *ncolfit_l, int *firth_l, int *maxit, double *maxstep, int *maxhs,
+	double *lconv, double *gconv, double *xconv, double *tau, int *threads, int *lowmem,
+	double *fisher_cov, double *Ustar, double *pi, double *Hdiag, double *loglik,
+	int *evals, int *iter, double *convergence, int *warning_prob, lf_arena *ws);
+void logistffit_IRLS_ws(double *x, lf_xstore *xs, int *y, int *n_l, int *k_l, double *weight, double *offset,
+	double *beta, int *colfit, int *ncolfit_l, int *firth_l, int *maxit, double *maxstep, int *maxhs,
+	double *lconv, double *gconv, double *xconv, double *tau, int *threads, int *lowmem,
+	double *fisher_cov, double *pi, double *Hdiag, double *loglik,
+	int *evals, int *iter, double *convergence, int *warning_prob, lf_arena *ws);
+void logistplfit_ws(double *x, lf_xstore *xs, int *y, int *n_l, int *k_l, double *weight, double *offset,
+	double *beta, int *iSel, int *which, double *LL0, int *firth_l,
+	int *maxit, double *maxstep, int *maxhs, double *lconv, double *xconv, double *tau, int *lowmem, int *accel,
+	double *betahist, double *loglik, int *iter, double *convergence, int *warning_prob, lf_arena *ws);
+
+#endif
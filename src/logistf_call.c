@@ -0,0 +1,1920 @@
+#include <limits.h>
+#include <string.h>
+#include <stdint.h>
+#include <R.h>
+#include <Rinternals.h>
+#define R_NO_REMAP_RMATH
+#include <Rmath.h>
+#include "lf_port.h"
+#include "logistf.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// .Call interface: the R vectors are read in place (coerced only if they are not of the storage
+// mode the fitting routines expect) and the results are returned as a named list, so neither the
+// design matrix nor unused output buffers are copied as with .C.
+// Instead of x, the fitting entry points also accept a prepared design (logistf_design_call) or a
+// memory-mapped design file (logistf_mmap_call), whose y, weight and offset are then used and whose
+// workspace arena is reused from fit to fit.
+
+// v as double / integer vector; protects and counts a coerced copy
+static SEXP asRealVector(SEXP v, int *nprot)
+{
+	if(TYPEOF(v) == REALSXP)
+		return v;
+	(*nprot)++;
+	return PROTECT(coerceVector(v, REALSXP));
+}
+
+static SEXP asIntegerVector(SEXP v, int *nprot)
+{
+	if(TYPEOF(v) == INTSXP)
+		return v;
+	(*nprot)++;
+	return PROTECT(coerceVector(v, INTSXP));
+}
+
+// named list of the given elements
+static SEXP namedList(const char **names, SEXP *values, int len)
+{
+	int i;
+	SEXP res = PROTECT(allocVector(VECSXP, len));
+	SEXP nms = PROTECT(allocVector(STRSXP, len));
+	for(i = 0; i < len; i++) {
+		SET_VECTOR_ELT(res, i, values[i]);
+		SET_STRING_ELT(nms, i, mkChar(names[i]));
+	}
+	setAttrib(res, R_NamesSymbol, nms);
+	UNPROTECT(2);
+	return res;
+}
+
+// x as a dgCMatrix (Matrix package) is passed to the fitting routines in compressed rows
+static int isSparse(SEXP x)
+{
+	return isS4(x) && inherits(x, "dgCMatrix");
+}
+
+// Compressed rows (lf_xstore) of the dgCMatrix x, whose compressed columns hold the row indices in
+// ascending order: the columns of each row are then ascending as well. The arrays are the elements of
+// the returned list, which the caller protects.
+static SEXP sparse_rows(SEXP x, lf_xstore *xs, int *n, int *k)
+{
+	SEXP dim = R_do_slot(x, install("Dim")), p = R_do_slot(x, install("p"));
+	SEXP i = R_do_slot(x, install("i")), v = R_do_slot(x, install("x"));
+	SEXP res;
+	int r, j, t, nnz, *next;
+
+	*n = INTEGER(dim)[0], *k = INTEGER(dim)[1];
+	nnz = INTEGER(p)[*k];
+	res = PROTECT(allocVector(VECSXP, 3));
+	SET_VECTOR_ELT(res, 0, allocVector(INTSXP, *n + 1));
+	SET_VECTOR_ELT(res, 1, allocVector(INTSXP, nnz));
+	SET_VECTOR_ELT(res, 2, allocVector(REALSXP, nnz));
+	xs->type = LF_XSPARSE;
+	xs->rowptr = INTEGER(VECTOR_ELT(res, 0));
+	xs->col = INTEGER(VECTOR_ELT(res, 1));
+	xs->val = REAL(VECTOR_ELT(res, 2));
+
+	memset(xs->rowptr, 0, (*n + 1) * sizeof(int));
+	for(t = 0; t < nnz; t++)
+		xs->rowptr[INTEGER(i)[t] + 1]++;
+	for(r = 0; r < *n; r++)
+		xs->rowptr[r + 1] += xs->rowptr[r];
+	next = (int *) R_alloc(*n + 1, sizeof(int));
+	memcpy(next, xs->rowptr, (*n + 1) * sizeof(int));
+	for(j = 0; j < *k; j++)
+		for(t = INTEGER(p)[j]; t < INTEGER(p)[j + 1]; t++) {
+			r = INTEGER(i)[t];
+			xs->col[next[r]] = j;
+			xs->val[next[r]++] = REAL(v)[t];
+		}
+	UNPROTECT(1);
+	return res;
+}
+
+// Prepared design: x (dense, sparse in compressed rows, dense in single precision or with bit-packed 0/1
+// columns), y, weight and offset in the storage modes of the fitting routines, either R vectors kept alive as the protected value of the external pointer
+// or a read-only mapping of a design file, and a workspace arena that grows to the largest workspace
+// requested so far. The finalizer releases the arena and the mapping.
+typedef struct {
+	int n, k;
+	double *x, *weight, *offset;
+	int *y;
+	lf_xstore sp, *xs;	// xs = &sp for a sparse, single precision or mixed design, NULL otherwise
+	void *map;			// mapped design file, NULL for in-memory designs
+	size_t maplen;
+	lf_arena arena;
+} logistf_design;
+
+static void design_finalize(SEXP ptr)
+{
+	logistf_design *d = (logistf_design *) R_ExternalPtrAddr(ptr);
+	if(d == NULL)
+		return;
+	ws_free(&d->arena);
+	if(d->map != NULL) {
+#ifdef _WIN32
+		UnmapViewOfFile(d->map);
+#else
+		munmap(d->map, d->maplen);
+#endif
+	}
+	free(d);
+	R_ClearExternalPtr(ptr);
+}
+
+static logistf_design *design_get(SEXP ptr)
+{
+	logistf_design *d = NULL;
+	if(TYPEOF(ptr) == EXTPTRSXP && TYPEOF(R_ExternalPtrTag(ptr)) == SYMSXP &&
+	   R_ExternalPtrTag(ptr) == install("logistf_design"))
+		d = (logistf_design *) R_ExternalPtrAddr(ptr);
+	if(d == NULL)
+		error("invalid or released logistf design");
+	return d;
+}
+
+// Mixed storage (lf_xstore LF_XMIXED) of the dense n x k matrix x if it has 0/1 columns: these are
+// bit-packed (64 rows per word), the others copied. Returns the list (bits, dense columns, cidx), which
+// the caller protects, or R_NilValue if no column is binary.
+static SEXP mixed_columns(double *x, lf_xstore *xs, int n, int k)
+{
+	SEXP res;
+	long nw = ((long) n + 63) / 64, i, j;
+	int nb = 0, nd = 0, *bin = (int *) R_alloc(k > 0 ? k : 1, sizeof(int));
+	double *xj;
+	uint64_t *bj;
+
+	for(j = 0; j < k; j++) {
+		xj = x + j*(long)n;
+		for(i = 0; i < n && (xj[i] == 0.0 || xj[i] == 1.0); i++);
+		bin[j] = (i == n);
+		nb += bin[j];
+	}
+	if(nb == 0)
+		return R_NilValue;
+	res = PROTECT(allocVector(VECSXP, 3));
+	SET_VECTOR_ELT(res, 0, allocVector(RAWSXP, nb * nw * sizeof(uint64_t)));
+	SET_VECTOR_ELT(res, 1, allocVector(REALSXP, (R_xlen_t)(k - nb) * n));
+	SET_VECTOR_ELT(res, 2, allocVector(INTSXP, k));
+	xs->type = LF_XMIXED;
+	xs->bits = (uint64_t *) RAW(VECTOR_ELT(res, 0));
+	xs->xd = REAL(VECTOR_ELT(res, 1));
+	xs->cidx = INTEGER(VECTOR_ELT(res, 2));
+	memset(xs->bits, 0, nb * nw * sizeof(uint64_t));
+	for(j = 0, nb = 0; j < k; j++) {
+		xj = x + j*(long)n;
+		if(bin[j]) {
+			bj = xs->bits + nb*nw;
+			for(i = 0; i < n; i++)
+				bj[i / 64] |= (uint64_t) (xj[i] == 1.0) << (i % 64);
+			xs->cidx[j] = -(++nb);
+		} else {
+			memcpy(xs->xd + nd*(long)n, xj, n * sizeof(double));
+			xs->cidx[j] = nd++;
+		}
+	}
+	UNPROTECT(1);
+	return res;
+}
+
+// single: store a dense x in single precision (a raw vector of n k floats), which halves the memory of
+// the design and the traffic of every pass over it; the fitting routines accumulate in double.
+// binary: store the 0/1 columns of a dense x bit-packed (see mixed_columns), 64 times smaller than in
+// double; the other columns stay in double. Takes precedence over single if x has a 0/1 column.
+// A sparse x is kept in compressed rows.
+SEXP logistf_design_call(SEXP x, SEXP y, SEXP weight, SEXP offset, SEXP single, SEXP binary)
+{
+	int nprot = 0, n, k, sparse = isSparse(x), single_i = !sparse && asLogical(single) == TRUE;
+	int mixed = 0;
+	lf_xstore sp = {0};
+	logistf_design *d;
+	SEXP data, ptr;
+
+	if(sparse) {
+		x = PROTECT(sparse_rows(x, &sp, &n, &k)); nprot++;
+	} else {
+		x = asRealVector(x, &nprot);
+	}
+	y = asIntegerVector(y, &nprot);
+	weight = asRealVector(weight, &nprot);
+	offset = asRealVector(offset, &nprot);
+	if(!sparse) {
+		n = LENGTH(y);
+		k = (n > 0) ? (int) (XLENGTH(x) / n) : 0;
+	}
+	if((!sparse && XLENGTH(x) != (R_xlen_t) n * k) || LENGTH(y) != n || LENGTH(weight) != n || LENGTH(offset) != n)
+		error("logistf_design_call: non-conforming arguments");
+	if(!sparse && asLogical(binary) == TRUE) {
+		SEXP xm = PROTECT(mixed_columns(REAL(x), &sp, n, k)); nprot++;
+		if(xm != R_NilValue) {
+			x = xm;
+			mixed = 1;
+			single_i = 0;
+		}
+	}
+	if(single_i) {
+		R_xlen_t i, nk = (R_xlen_t) n * k;
+		double *xd = REAL(x);
+		x = PROTECT(allocVector(RAWSXP, nk * sizeof(float))); nprot++;
+		sp.type = LF_XFLOAT;
+		sp.xf = (float *) RAW(x);
+		for(i = 0; i < nk; i++)
+			sp.xf[i] = (float) xd[i];
+	}
+
+	data = PROTECT(allocVector(VECSXP, 4)); nprot++;
+	SET_VECTOR_ELT(data, 0, x);
+	SET_VECTOR_ELT(data, 1, y);
+	SET_VECTOR_ELT(data, 2, weight);
+	SET_VECTOR_ELT(data, 3, offset);
+	if(NULL == (d = (logistf_design *) calloc(1, sizeof(logistf_design))))
+		error("no memory available\n");
+	d->n = n;
+	d->k = k;
+	d->x = (sparse || single_i || mixed) ? NULL : REAL(x), d->y = INTEGER(y), d->weight = REAL(weight), d->offset = REAL(offset);
+	d->sp = sp;
+	d->xs = (sparse || single_i || mixed) ? &d->sp : NULL;
+	ptr = PROTECT(R_MakeExternalPtr(d, install("logistf_design"), data)); nprot++;
+	R_RegisterCFinalizerEx(ptr, design_finalize, TRUE);
+	UNPROTECT(nprot);
+	return ptr;
+}
+
+// Design file (written by logistf.write): a 32 byte header
+//   "LOGISTF1", int32 n, int32 k, double 1.0 (byte order check), int32 length of the names, int32 0
+// followed by x (n x k, column-major), weight and offset as doubles, y as int32 and the k column names
+// separated by '\0', all in little-endian byte order. The doubles are 8-byte aligned in the file and
+// hence in the mapping, so the fitting routines read them in place: with lowmem they stream the design
+// in tiles of rows, and the operating system pages x in and out as needed.
+#define LF_FILE_MAGIC	"LOGISTF1"
+#define LF_FILE_HEADER	32
+
+typedef struct {
+	char magic[8];
+	int n, k;
+	double check;
+	int namelen, reserved;
+} lf_file_header;
+
+SEXP logistf_mmap_call(SEXP file)
+{
+	const char *path;
+	lf_file_header h;
+	logistf_design *d;
+	size_t len, need;
+	char *map;
+	SEXP ptr;
+
+	if(!isString(file) || LENGTH(file) != 1 || STRING_ELT(file, 0) == NA_STRING)
+		error("logistf_mmap_call: invalid file name");
+	path = R_ExpandFileName(translateChar(STRING_ELT(file, 0)));
+
+#ifdef _WIN32
+	HANDLE fh, mh;
+	LARGE_INTEGER size;
+	fh = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(fh == INVALID_HANDLE_VALUE)
+		error("cannot open design file '%s'", path);
+	if(!GetFileSizeEx(fh, &size) || (size_t) size.QuadPart < LF_FILE_HEADER) {
+		CloseHandle(fh);
+		error("'%s' is not a logistf design file", path);
+	}
+	len = (size_t) size.QuadPart;
+	mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+	map = (mh == NULL) ? NULL : (char *) MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+	if(mh != NULL)
+		CloseHandle(mh);
+	CloseHandle(fh);
+	if(map == NULL)
+		error("cannot map design file '%s'", path);
+#define LF_UNMAP() UnmapViewOfFile(map)
+#else
+	int fd;
+	struct stat st;
+	if((fd = open(path, O_RDONLY)) < 0)
+		error("cannot open design file '%s'", path);
+	if(fstat(fd, &st) != 0 || (size_t) st.st_size < LF_FILE_HEADER) {
+		close(fd);
+		error("'%s' is not a logistf design file", path);
+	}
+	len = (size_t) st.st_size;
+	map = (char *) mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		error("cannot map design file '%s'", path);
+#ifdef MADV_SEQUENTIAL
+	madvise(map, len, MADV_SEQUENTIAL);
+#endif
+#define LF_UNMAP() munmap(map, len)
+#endif
+
+	memcpy(&h, map, sizeof(h));
+	if(memcmp(h.magic, LF_FILE_MAGIC, 8) != 0) {
+		LF_UNMAP();
+		error("'%s' is not a logistf design file", path);
+	}
+	if(h.check != 1.0) {
+		LF_UNMAP();
+		error("design file '%s' has a different byte order", path);
+	}
+	if(h.n <= 0 || h.k <= 0 || h.k > INT_MAX - 2 || h.namelen < 0) {
+		LF_UNMAP();
+		error("design file '%s' has an invalid header", path);
+	}
+	// bytes per row (k + 2 doubles and y), then the size of the file, checked for overflow of size_t
+	need = 0;
+	if((size_t) h.k + 2 <= (SIZE_MAX - sizeof(int)) / sizeof(double)) {
+		size_t row = ((size_t) h.k + 2) * sizeof(double) + sizeof(int);
+		if((size_t) h.n <= (SIZE_MAX - LF_FILE_HEADER - (size_t) h.namelen) / row)
+			need = LF_FILE_HEADER + (size_t) h.n * row + (size_t) h.namelen;
+	}
+	if(need == 0 || len < need) {
+		LF_UNMAP();
+		error("design file '%s' is truncated", path);
+	}
+	if(NULL == (d = (logistf_design *) calloc(1, sizeof(logistf_design)))) {
+		LF_UNMAP();
+		error("no memory available\n");
+	}
+#undef LF_UNMAP
+	d->n = h.n;
+	d->k = h.k;
+	d->x = (double *) (map + LF_FILE_HEADER);
+	d->weight = d->x + (size_t) h.n * h.k;
+	d->offset = d->weight + h.n;
+	d->y = (int *) (d->offset + h.n);
+	d->map = map;
+	d->maplen = len;
+	ptr = PROTECT(R_MakeExternalPtr(d, install("logistf_design"), R_NilValue));
+	R_RegisterCFinalizerEx(ptr, design_finalize, TRUE);
+	UNPROTECT(1);
+	return ptr;
+}
+
+// Data of a fit: from a prepared design x, or x (dense or dgCMatrix), y, weight and offset read in place
+typedef struct {
+	int n, k;
+	double *x, *weight, *offset;
+	int *y;
+	lf_xstore sp, *xs;	// compressed rows of a sparse x, xs NULL for dense x
+	lf_arena *ws;		// arena of the prepared design, NULL otherwise
+} lf_data;
+
+static void get_data(SEXP x, SEXP y, SEXP weight, SEXP offset, int *nprot, const char *caller, lf_data *dat)
+{
+	if(TYPEOF(x) == EXTPTRSXP) {
+		logistf_design *d = design_get(x);
+		dat->n = d->n, dat->k = d->k;
+		dat->x = d->x, dat->y = d->y, dat->weight = d->weight, dat->offset = d->offset;
+		dat->xs = d->xs;
+		dat->ws = &d->arena;
+		dat->ws->trace = NULL;	// left over by a fit interrupted by an error
+		return;
+	}
+	y = asIntegerVector(y, nprot);
+	weight = asRealVector(weight, nprot);
+	offset = asRealVector(offset, nprot);
+	if(isSparse(x)) {
+		PROTECT(sparse_rows(x, &dat->sp, &dat->n, &dat->k)); (*nprot)++;
+		dat->x = NULL;
+		dat->xs = &dat->sp;
+	} else {
+		x = asRealVector(x, nprot);
+		dat->n = LENGTH(y);
+		dat->k = (dat->n > 0) ? (int) (XLENGTH(x) / dat->n) : 0;
+		if(XLENGTH(x) != (R_xlen_t) dat->n * dat->k)
+			error("%s: non-conforming arguments", caller);
+		dat->x = REAL(x);
+		dat->xs = NULL;
+	}
+	if(LENGTH(y) != dat->n || LENGTH(weight) != dat->n || LENGTH(offset) != dat->n)
+		error("%s: non-conforming arguments", caller);
+	dat->y = INTEGER(y), dat->weight = REAL(weight), dat->offset = REAL(offset);
+	dat->ws = NULL;
+}
+
+// the data as a problem of the plain C interface (logistf.h)
+static lf_problem data_problem(lf_data *dat)
+{
+	lf_problem p = {dat->n, dat->k, dat->x, dat->xs, dat->y, dat->weight, dat->offset};
+	return p;
+}
+
+// settings of the fits of an entry point: the list of logistf.settings (firth, method, maxit, maxstep, maxhs,
+// lconv, gconv, xconv, tau, threads, lowmem), validated there; threads NA or below 1 means 1
+static void lf_control_from_sexp(SEXP settings, lf_control *s)
+{
+	if(TYPEOF(settings) != VECSXP || LENGTH(settings) != 11)
+		error("invalid fit settings");
+	s->firth = asInteger(VECTOR_ELT(settings, 0)), s->method = asInteger(VECTOR_ELT(settings, 1));
+	s->maxit = asInteger(VECTOR_ELT(settings, 2)), s->maxstep = asReal(VECTOR_ELT(settings, 3));
+	s->maxhs = asInteger(VECTOR_ELT(settings, 4)), s->lconv = asReal(VECTOR_ELT(settings, 5));
+	s->gconv = asReal(VECTOR_ELT(settings, 6)), s->xconv = asReal(VECTOR_ELT(settings, 7));
+	s->tau = asReal(VECTOR_ELT(settings, 8)), s->threads = asInteger(VECTOR_ELT(settings, 9));
+	s->lowmem = asInteger(VECTOR_ELT(settings, 10));
+	if(s->method != LF_NR && s->method != LF_IRLS && s->method != LF_TR)
+		error("invalid fitting method");
+	if(s->threads == NA_INTEGER || s->threads < 1)
+		s->threads = 1;
+}
+
+// trace of a fit (logistf.control(trace = TRUE)) by R_alloc, storing up to maxiter iterations
+static lf_trace *trace_new(int maxiter)
+{
+	lf_trace *tr = (lf_trace *) R_alloc(1, sizeof(lf_trace));
+	lf_trace_reset(tr);
+	tr->maxiter = (maxiter > 0) ? maxiter : 0;
+	tr->loglik = (double *) R_alloc(3 * (size_t) tr->maxiter + 1, sizeof(double));
+	tr->delta = tr->loglik + tr->maxiter;
+	tr->score = tr->delta + tr->maxiter;
+	tr->halfs = (int *) R_alloc(tr->maxiter + 1, sizeof(int));
+	return tr;
+}
+
+// the trace as list(time, halvings, clips, iterations): seconds per phase and in total, counters,
+// and the matrix of the iterations (stored ones) with the columns loglik, max.delta, max.score, halvings
+static SEXP trace_value(const lf_trace *tr)
+{
+	static const char *phases[] = {"lik", "gram", "chol", "hat", "score", "total"};
+	static const char *cols[] = {"loglik", "max.delta", "max.score", "halvings"};
+	int j, r, m;
+	SEXP time, tn, iters, dn, cn;
+
+	if(tr == NULL)
+		return R_NilValue;
+	m = (tr->niter < tr->maxiter) ? tr->niter : tr->maxiter;
+	time = PROTECT(allocVector(REALSXP, LF_NPHASE + 1));
+	tn = PROTECT(allocVector(STRSXP, LF_NPHASE + 1));
+	for(j = 0; j <= LF_NPHASE; j++) {
+		REAL(time)[j] = (j < LF_NPHASE) ? tr->time[j] : tr->total;
+		SET_STRING_ELT(tn, j, mkChar(phases[j]));
+	}
+	setAttrib(time, R_NamesSymbol, tn);
+	iters = PROTECT(allocMatrix(REALSXP, m, 4));
+	for(r = 0; r < m; r++) {
+		REAL(iters)[r] = tr->loglik[r];
+		REAL(iters)[r + m] = tr->delta[r];
+		REAL(iters)[r + 2 * m] = tr->score[r];
+		REAL(iters)[r + 3 * m] = tr->halfs[r];
+	}
+	dn = PROTECT(allocVector(VECSXP, 2));
+	cn = PROTECT(allocVector(STRSXP, 4));
+	for(j = 0; j < 4; j++)
+		SET_STRING_ELT(cn, j, mkChar(cols[j]));
+	SET_VECTOR_ELT(dn, 1, cn);
+	setAttrib(iters, R_DimNamesSymbol, dn);
+
+	const char *names[] = {"time", "halvings", "clips", "iterations"};
+	SEXP values[] = {time, PROTECT(ScalarInteger(tr->halvings)), PROTECT(ScalarInteger(tr->clips)), iters};
+	SEXP res = namedList(names, values, 4);
+	UNPROTECT(7);
+	return res;
+}
+
+// method: 0 Newton-Raphson (logistffit_revised), 1 IRLS (logistffit_IRLS), 2 trust-region Newton (logistffit_TR)
+SEXP logistffit_call(SEXP x, SEXP y, SEXP weight, SEXP offset, SEXP init, SEXP colfit, SEXP settings, SEXP trace)
+{
+	int nprot = 0;
+	int n, k;
+	double t0 = 0.0;
+	SEXP beta, var, Ustar, pi, Hdiag, conv;
+	lf_data dat;
+	lf_arena *ws, local = {0};
+	lf_problem p;
+	lf_control s;
+	lf_fit f = {0};
+	lf_trace *tr = NULL;
+
+	get_data(x, y, weight, offset, &nprot, "logistffit_call", &dat);
+	n = dat.n, k = dat.k, ws = dat.ws;
+	colfit = asIntegerVector(colfit, &nprot);
+	if(LENGTH(init) != k)
+		error("logistffit_call: non-conforming arguments");
+	p = data_problem(&dat);
+	lf_control_from_sexp(settings, &s);
+
+	// beta is I/O in the fitting routines: work on a fresh copy of init
+	beta = PROTECT((TYPEOF(init) == REALSXP) ? duplicate(init) : coerceVector(init, REALSXP)); nprot++;
+	var = PROTECT(allocMatrix(REALSXP, k, k)); nprot++;
+	pi = PROTECT(allocVector(REALSXP, n)); nprot++;
+	Hdiag = PROTECT(allocVector(REALSXP, n)); nprot++;
+	conv = PROTECT(allocVector(REALSXP, 3)); nprot++;
+	if(s.method == LF_IRLS) {
+		Ustar = R_NilValue;
+	} else {
+		Ustar = PROTECT(allocVector(REALSXP, k)); nprot++;
+		f.score = REAL(Ustar);
+	}
+	f.beta = REAL(beta), f.var = REAL(var), f.pi = REAL(pi), f.hdiag = REAL(Hdiag);
+	if(asLogical(trace) == TRUE) {
+		tr = trace_new(s.maxit);
+		if(ws == NULL)
+			ws = &local;	// no design: R_alloc as without an arena, but the trace needs one
+		ws->trace = tr;
+		t0 = lf_clock();
+	}
+
+	lf_fit_run(&p, INTEGER(colfit), LENGTH(colfit), &s, &f, ws);
+	if(tr != NULL) {
+		tr->total = lf_clock() - t0;
+		ws->trace = NULL;
+	}
+	if(ws != NULL && ws != &local)
+		ws_reserve(ws);
+	memcpy(REAL(conv), f.conv, 3 * sizeof(double));
+
+	const char *names[] = {"beta", "var", "Ustar", "pi", "Hdiag", "loglik", "evals", "iter", "conv", "warning_prob",
+		"trace"};
+	SEXP values[] = {beta, var, Ustar, pi, Hdiag,
+		PROTECT(ScalarReal(f.loglik)), PROTECT(ScalarInteger(f.evals)), PROTECT(ScalarInteger(f.iter)),
+		conv, PROTECT(ScalarInteger(f.warning_prob)), PROTECT(trace_value(tr))};
+	nprot += 5;
+	SEXP res = namedList(names, values, 11);
+	UNPROTECT(nprot);
+	return res;
+}
+
+// profile likelihood limit for variable i; the k x maxit history of beta is returned
+// (as its first iter rows) only if keephist is TRUE. With accel, init must be the maximum of the
+// (penalized) likelihood and the search starts from an extrapolated limit (see pl_seed in logistf.c).
+SEXP logistplfit_call(SEXP x, SEXP y, SEXP weight, SEXP offset, SEXP init, SEXP i, SEXP which, SEXP LL0,
+                      SEXP firth, SEXP maxit, SEXP maxstep, SEXP maxhs, SEXP lconv, SEXP xconv, SEXP tau,
+                      SEXP lowmem, SEXP accel, SEXP keephist, SEXP trace)
+{
+	int nprot = 0;
+	int n, k, i_i, which_i, firth_i, maxit_i, maxhs_i, lowmem_i, accel_i, iter = 0, warning_prob = 0;
+	double LL0_d, maxstep_d, lconv_d, xconv_d, tau_d, loglik = 0.0, t0 = 0.0;
+	double *betahist;
+	long r, j;
+	SEXP beta, conv, hist;
+	lf_data dat;
+	lf_arena *ws, local = {0};
+	lf_trace *tr = NULL;
+
+	get_data(x, y, weight, offset, &nprot, "logistplfit_call", &dat);
+	n = dat.n, k = dat.k, ws = dat.ws;
+	if(LENGTH(init) != k)
+		error("logistplfit_call: non-conforming arguments");
+	i_i = asInteger(i), which_i = asInteger(which), firth_i = asInteger(firth);
+	maxit_i = asInteger(maxit), maxhs_i = asInteger(maxhs), lowmem_i = asInteger(lowmem), accel_i = asInteger(accel);
+	LL0_d = asReal(LL0), maxstep_d = asReal(maxstep), lconv_d = asReal(lconv), xconv_d = asReal(xconv);
+	tau_d = asReal(tau);
+	if(i_i < 1 || i_i > k)
+		error("logistplfit_call: invalid variable index");
+
+	beta = PROTECT((TYPEOF(init) == REALSXP) ? duplicate(init) : coerceVector(init, REALSXP)); nprot++;
+	conv = PROTECT(allocVector(REALSXP, 2)); nprot++;
+	memset(REAL(conv), 0, 2 * sizeof(double));
+	betahist = (double *) R_alloc((size_t) k * (maxit_i > 0 ? maxit_i : 1), sizeof(double));
+	if(asLogical(trace) == TRUE) {
+		tr = trace_new(maxit_i);
+		if(ws == NULL)
+			ws = &local;
+		ws->trace = tr;
+		t0 = lf_clock();
+	}
+
+	logistplfit_ws(dat.x, dat.xs, dat.y, &n, &k, dat.weight, dat.offset, REAL(beta),
+		&i_i, &which_i, &LL0_d, &firth_i, &maxit_i, &maxstep_d, &maxhs_i, &lconv_d, &xconv_d, &tau_d, &lowmem_i, &accel_i,
+		betahist, &loglik, &iter, REAL(conv), &warning_prob, ws);
+	if(tr != NULL) {
+		tr->total = lf_clock() - t0;
+		ws->trace = NULL;
+	}
+	if(ws != NULL && ws != &local)
+		ws_reserve(ws);
+
+	if(asLogical(keephist) == TRUE) {
+		hist = PROTECT(allocMatrix(REALSXP, iter, k)); nprot++;
+		for(j = 0; j < k; j++)
+			for(r = 0; r < iter; r++)
+				REAL(hist)[r + j * iter] = betahist[j * maxit_i + r];
+	} else {
+		hist = R_NilValue;
+	}
+
+	const char *names[] = {"beta", "betahist", "loglik", "iter", "conv", "warning_prob", "trace"};
+	SEXP values[] = {beta, hist, PROTECT(ScalarReal(loglik)), PROTECT(ScalarInteger(iter)),
+		conv, PROTECT(ScalarInteger(warning_prob)), PROTECT(trace_value(tr))};
+	nprot += 4;
+	SEXP res = namedList(names, values, 7);
+	UNPROTECT(nprot);
+	return res;
+}
+
+// nthreads arenas in collect mode of size bytes each, allocated by R_alloc for parallel fits
+static lf_arena *thread_arenas(int nthreads, size_t size)
+{
+	int t;
+	lf_arena *arenas = (lf_arena *) R_alloc(nthreads, sizeof(lf_arena));
+	for(t = 0; t < nthreads; t++) {
+		arenas[t].size = size;
+		arenas[t].base = R_alloc(size + 1, 1);
+		arenas[t].used = arenas[t].need = 0;
+		arenas[t].collect = 1;
+		arenas[t].status = LF_OK;
+		arenas[t].allocator = NULL;
+		arenas[t].trace = NULL;
+	}
+	return arenas;
+}
+
+// Batch of independent jobs of an entry point (submodels, candidate models, chains of a profile, imputed
+// data sets, profile likelihood searches). With threads > 1 the jobs run in parallel, one per thread, each
+// on its own arena in collect mode; job first runs serially before, to size these arenas. With own, each
+// job runs on the arena of its data instead (distinct for all jobs), and the jobs whose arena is not sized
+// yet run serially before. A job that fails in parallel is restarted from its starting values and run
+// serially, so its error is raised as usual. Serial runs use threads threads within the fit and grow the
+// arena of their data, unless it is scratch (an entry point without a prepared design), which only
+// records the size of the workspace.
+typedef struct {
+	int njobs, first, threads, own;
+	void *ctx;
+	void (*run)(void *ctx, int j, int threads, int tid, lf_arena *ws);	// job j on ws, buffers of thread tid
+	void (*restart)(void *ctx, int j);			// job j back to its starting values
+	lf_arena *(*arena)(void *ctx, int j);		// arena of the data of job j
+	lf_arena *scratch;
+} lf_batch;
+
+static void batch_serial(const lf_batch *b, int j, int threads)
+{
+	const void *vmax = vmaxget();
+	lf_arena *ws = b->arena(b->ctx, j);
+
+	b->run(b->ctx, j, threads, 0, ws);
+	if(ws != b->scratch)
+		ws_reserve(ws);
+	vmaxset(vmax);
+}
+
+static void batch_run(const lf_batch *b)
+{
+	int j, nthreads = b->own ? b->njobs : b->njobs - 1, *serial, *failed;
+	lf_arena *arenas = NULL;
+
+	if(nthreads > b->threads)
+		nthreads = b->threads;
+	serial = (int *) R_alloc(2 * (size_t) b->njobs + 1, sizeof(int));
+	failed = serial + b->njobs;
+	for(j = 0; j < b->njobs; j++) {
+		serial[j] = (nthreads <= 1 || (b->own ? b->arena(b->ctx, j)->size == 0 : j == b->first));
+		failed[j] = 0;
+		if(serial[j])
+			batch_serial(b, j, b->threads);
+	}
+	if(nthreads <= 1)
+		return;
+
+	if(b->own) {
+		for(j = 0; j < b->njobs; j++)
+			if(!serial[j])
+				b->arena(b->ctx, j)->collect = 1;
+	} else {
+		arenas = thread_arenas(nthreads, b->arena(b->ctx, b->first)->need);
+	}
+	#pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+	for(j = 0; j < b->njobs; j++) {
+		int tid = 0;
+		lf_arena *ws;
+#ifdef _OPENMP
+		tid = omp_get_thread_num();
+#endif
+		if(serial[j])
+			continue;
+		ws = b->own ? b->arena(b->ctx, j) : arenas + tid;
+		b->run(b->ctx, j, 1, tid, ws);
+		failed[j] = (ws->status != LF_OK);
+	}
+	for(j = 0; j < b->njobs; j++) {
+		if(b->own && !serial[j]) {
+			b->arena(b->ctx, j)->collect = 0;
+			b->arena(b->ctx, j)->status = LF_OK;
+		}
+		if(failed[j]) {
+			b->restart(b->ctx, j);
+			batch_serial(b, j, 1);
+		}
+	}
+}
+
+// Fits of a batch (see batch_run): job j fits the columns colfit[j] (1-based, 0: evaluate the likelihood
+// only) of problem p[d[j]] (p[0] if d is NULL) on the arena ws[d[j]] from column j of start (k x m) into
+// column j of beta, in which the columns not fitted hold their fixed values. The covariance of a job
+// j < nvar is kept in var (k x k x nvar); the output buffers not returned are per thread (n: the largest
+// number of rows).
+typedef struct {
+	const lf_problem *p;
+	lf_arena **ws;
+	const int *d;
+	int k, n, nvar, **colfit, *ncolfit;
+	const lf_control *s;
+	const double *start;
+	double *beta, *loglik, *conv, *var, *tvar, *Ustar, *pi, *Hdiag;
+	int *evals, *iter, *warning_prob;
+} fit_batch;
+
+// the per-thread output buffers of the fits of a batch of k columns and at most n rows
+static void fit_batch_buffers(fit_batch *fb, int k, int n, int threads)
+{
+	fb->k = k, fb->n = n;
+	fb->tvar = (double *) R_alloc((size_t) threads * k * k + 1, sizeof(double));
+	fb->Ustar = (double *) R_alloc((size_t) threads * k + 1, sizeof(double));
+	fb->pi = (double *) R_alloc((size_t) threads * n + 1, sizeof(double));
+	fb->Hdiag = (double *) R_alloc((size_t) threads * n + 1, sizeof(double));
+}
+
+static void fit_batch_run(void *ctx, int j, int threads, int tid, lf_arena *ws)
+{
+	fit_batch *fb = (fit_batch *) ctx;
+	size_t k = fb->k, n = fb->n;
+	lf_control c = *fb->s;
+	lf_fit f = {fb->beta + j * k, (j < fb->nvar) ? fb->var + j * k * k : fb->tvar + tid * k * k,
+		fb->Ustar + tid * k, fb->pi + tid * n, fb->Hdiag + tid * n, 0.0, {0.0, 0.0, 0.0}, 0, 0, 0};
+
+	c.maxit = (fb->colfit[j][0] == 0) ? 0 : fb->s->maxit;	// only evaluate the likelihood
+	c.threads = threads;
+	lf_fit_run(fb->p + (fb->d ? fb->d[j] : 0), fb->colfit[j], fb->ncolfit[j], &c, &f, ws);
+	fb->loglik[j] = f.loglik, fb->evals[j] = f.evals, fb->iter[j] = f.iter, fb->warning_prob[j] = f.warning_prob;
+	memcpy(fb->conv + 3 * j, f.conv, 3 * sizeof(double));
+}
+
+static void fit_batch_restart(void *ctx, int j)
+{
+	fit_batch *fb = (fit_batch *) ctx;
+	memcpy(fb->beta + (size_t) j * fb->k, fb->start + (size_t) j * fb->k, fb->k * sizeof(double));
+}
+
+static lf_arena *fit_batch_arena(void *ctx, int j)
+{
+	fit_batch *fb = (fit_batch *) ctx;
+	return fb->ws[fb->d ? fb->d[j] : 0];
+}
+
+// the batch of fits of fb as m jobs; first: the job of the largest workspace
+static void fit_batch_run_all(fit_batch *fb, int m, int first, int own, lf_arena *scratch)
+{
+	lf_batch b = {m, first, fb->s->threads, own, fb, fit_batch_run, fit_batch_restart, fit_batch_arena, scratch};
+	batch_run(&b);
+}
+
+// the list colfits of column sets (1-based, 0 alone: none) of a design of k columns
+static void column_sets(SEXP colfits, int k, int **colfit, int *ncolfit, int *nprot, const char *caller)
+{
+	int j, t;
+	SEXP v;
+
+	for(j = 0; j < LENGTH(colfits); j++) {
+		v = asIntegerVector(VECTOR_ELT(colfits, j), nprot);
+		ncolfit[j] = LENGTH(v);
+		colfit[j] = INTEGER(v);
+		if(ncolfit[j] < 1)
+			error("%s: invalid column index", caller);
+		for(t = 0; t < ncolfit[j] && !(ncolfit[j] == 1 && colfit[j][0] == 0); t++)
+			if(colfit[j][t] < 1 || colfit[j][t] > k)
+				error("%s: invalid column index", caller);
+	}
+}
+
+// Batch of submodels of one design (nested models of PLR tests, drop1, anova): colfits is a list of
+// 1-based column sets to fit (0: evaluate the likelihood at the starting values only) and init the
+// k x m matrix of their starting values, in which the columns not fitted hold their fixed values.
+// With threads > 1 the submodels are fitted in parallel (see batch_run); the caller passes the one
+// with most columns first.
+SEXP logistf_submodels_call(SEXP x, SEXP y, SEXP weight, SEXP offset, SEXP init, SEXP colfits, SEXP settings)
+{
+	int nprot = 0;
+	int k, m;
+	lf_control s;
+	lf_problem p;
+	lf_arena local = {0}, *ws;
+	SEXP beta, ll, it, ev, conv, wp;
+	lf_data dat;
+	fit_batch fb = {0};
+
+	get_data(x, y, weight, offset, &nprot, "logistf_submodels_call", &dat);
+	k = dat.k;
+	ws = (dat.ws != NULL) ? dat.ws : &local;	// no design: R_alloc, but record the size of the workspace
+	init = asRealVector(init, &nprot);
+	m = LENGTH(colfits);
+	if(LENGTH(init) != k * m)
+		error("logistf_submodels_call: non-conforming arguments");
+	p = data_problem(&dat);
+	lf_control_from_sexp(settings, &s);
+	fb.colfit = (int **) R_alloc(m + 1, sizeof(int *));
+	fb.ncolfit = (int *) R_alloc(m + 1, sizeof(int));
+	column_sets(colfits, k, fb.colfit, fb.ncolfit, &nprot, "logistf_submodels_call");
+
+	beta = PROTECT(duplicate(init)); nprot++;
+	ll = PROTECT(allocVector(REALSXP, m)); nprot++;
+	it = PROTECT(allocVector(INTSXP, m)); nprot++;
+	ev = PROTECT(allocVector(INTSXP, m)); nprot++;
+	conv = PROTECT(allocMatrix(REALSXP, 3, m)); nprot++;
+	wp = PROTECT(allocVector(INTSXP, m)); nprot++;
+	memset(REAL(conv), 0, 3 * (size_t) m * sizeof(double));
+	fb.p = &p, fb.ws = &ws, fb.s = &s, fb.start = REAL(init);
+	fb.beta = REAL(beta), fb.loglik = REAL(ll), fb.conv = REAL(conv);
+	fb.evals = INTEGER(ev), fb.iter = INTEGER(it), fb.warning_prob = INTEGER(wp);
+	fit_batch_buffers(&fb, k, dat.n, (s.threads < m) ? s.threads : m);
+	fit_batch_run_all(&fb, m, 0, 0, &local);
+
+	const char *names[] = {"beta", "loglik", "iter", "evals", "conv", "warning_prob"};
+	SEXP values[] = {beta, ll, it, ev, conv, wp};
+	SEXP res = namedList(names, values, 6);
+	UNPROTECT(nprot);
+	return res;
+}
+
+// Columns (0-based) of the model of the terms in with term u toggled (u = -1: none) into cols, in
+// ascending order, those of no term (colterm -1) always included; returns their number
+static int model_columns(const int *colterm, const int *in, int k, int u, int *cols)
+{
+	int j, nc = 0;
+
+	for(j = 0; j < k; j++)
+		if(colterm[j] < 0 || (in[colterm[j]] != 0) != (colterm[j] == u))
+			cols[nc++] = j;
+	return nc;
+}
+
+// Design of the columns cols (0-based, ascending) of the data dat, a model of the stepwise selection, in
+// buffers allocated once for all models (sub_alloc): a dense or single precision x is copied column by
+// column, the columns of a mixed store are mapped (cidx) and the rows of a sparse x are filtered
+typedef struct {
+	lf_problem p;
+	lf_xstore xs;
+	double *x, *val;
+	float *xf;
+	int *cidx, *rowptr, *col, *newcol;
+} lf_sub;
+
+static void sub_alloc(const lf_data *dat, lf_sub *sb)
+{
+	size_t n = dat->n, k = dat->k;
+
+	memset(sb, 0, sizeof(lf_sub));
+	if(dat->xs == NULL) {
+		sb->x = (double *) R_alloc(n * k + 1, sizeof(double));
+	} else if(dat->xs->type == LF_XFLOAT) {
+		sb->xf = (float *) R_alloc(n * k + 1, sizeof(float));
+	} else if(dat->xs->type == LF_XMIXED) {
+		sb->cidx = (int *) R_alloc(k + 1, sizeof(int));
+	} else {
+		sb->rowptr = (int *) R_alloc(n + 1, sizeof(int));
+		sb->col = (int *) R_alloc((size_t) dat->xs->rowptr[n] + 1, sizeof(int));
+		sb->val = (double *) R_alloc((size_t) dat->xs->rowptr[n] + 1, sizeof(double));
+		sb->newcol = (int *) R_alloc(k + 1, sizeof(int));
+	}
+}
+
+static void sub_design(const lf_data *dat, const int *cols, int kc, lf_sub *sb)
+{
+	size_t n = dat->n, j;
+	const lf_xstore *xs = dat->xs;
+
+	sb->p.n = dat->n, sb->p.k = kc;
+	sb->p.y = dat->y, sb->p.weight = dat->weight, sb->p.offset = dat->offset;
+	sb->p.x = NULL, sb->p.xs = NULL;
+	if(xs == NULL) {
+		for(j = 0; j < (size_t) kc; j++)
+			memcpy(sb->x + j * n, dat->x + cols[j] * n, n * sizeof(double));
+		sb->p.x = sb->x;
+		return;
+	}
+	sb->xs = *xs;
+	sb->p.xs = &sb->xs;
+	if(xs->type == LF_XFLOAT) {
+		for(j = 0; j < (size_t) kc; j++)
+			memcpy(sb->xf + j * n, xs->xf + cols[j] * n, n * sizeof(float));
+		sb->xs.xf = sb->xf;
+	} else if(xs->type == LF_XMIXED) {
+		for(j = 0; j < (size_t) kc; j++)
+			sb->cidx[j] = xs->cidx[cols[j]];
+		sb->xs.cidx = sb->cidx;
+	} else {
+		int i, r, t = 0;
+		for(j = 0; j < (size_t) dat->k; j++)
+			sb->newcol[j] = -1;
+		for(j = 0; j < (size_t) kc; j++)
+			sb->newcol[cols[j]] = (int) j;
+		sb->rowptr[0] = 0;
+		for(i = 0; i < dat->n; i++) {
+			for(r = xs->rowptr[i]; r < xs->rowptr[i + 1]; r++)
+				if(sb->newcol[xs->col[r]] >= 0) {
+					sb->col[t] = sb->newcol[xs->col[r]];
+					sb->val[t++] = xs->val[r];
+				}
+			sb->rowptr[i + 1] = t;
+		}
+		sb->xs.rowptr = sb->rowptr, sb->xs.col = sb->col, sb->xs.val = sb->val;
+	}
+}
+
+// log-likelihood of a model without columns: the linear predictor is the offset
+static double offset_loglik(const lf_problem *p)
+{
+	int i;
+	double eta, ll = 0.0;
+
+	for(i = 0; i < p->n; i++) {
+		eta = p->offset[i];
+		ll += p->weight[i] * (p->y[i] * eta - fmax(eta, 0.0) - log1p(exp(-fabs(eta))));
+	}
+	return ll;
+}
+
+// Candidate models of a step of logistf_stepwise_call, the jobs of a batch (see batch_run): candidate c
+// toggles term cand[c] of the current model (columns mcols, estimates cur). Each run starts from cur, the
+// columns of the term at 0. Backward, the candidate is fitted on the design of the current model (sub[0])
+// into loglik[c]; forward, the model with the term is fitted on its own design (sub[tid]) into loglik[c]
+// and beta (k per candidate, by its columns), and the model without it on the same design into llnull[c].
+typedef struct {
+	const lf_data *dat;
+	const lf_control *s;
+	lf_arena *ws;
+	int k, n, dir, nmcols, *colterm, *in, *cand, *mcols;
+	const double *cur;
+	lf_sub *sub;
+	int *cols, *colfit;		// per thread, k each
+	double *b0, *var, *Ustar, *pi, *Hdiag;		// per thread
+	double *beta, *loglik, *llnull;
+	int *warning_prob;
+} step_batch;
+
+// fit of the columns colfit (1-based, 0: evaluate the likelihood only) of q from beta on the buffers of
+// thread tid into *loglik; returns 0 if it failed on an arena in collect mode
+static int step_fit(step_batch *sb, const lf_problem *q, double *beta, int *colfit, int ncolfit, int threads,
+                    int tid, lf_arena *ws, double *loglik, int *warning_prob)
+{
+	size_t k = sb->k, n = sb->n;
+	lf_control c = *sb->s;
+	lf_fit f = {beta, sb->var + tid * k * k, sb->Ustar + tid * k, sb->pi + tid * n, sb->Hdiag + tid * n,
+		0.0, {0.0, 0.0, 0.0}, 0, 0, 0};
+
+	if(q->k == 0) {
+		*loglik = offset_loglik(q);
+		return 1;
+	}
+	c.maxit = (colfit[0] == 0) ? 0 : sb->s->maxit;	// only evaluate the likelihood
+	c.threads = threads;
+	lf_fit_run(q, colfit, ncolfit, &c, &f, ws);
+	*loglik = f.loglik;
+	*warning_prob |= f.warning_prob;
+	return !(ws->collect && ws->status != LF_OK);
+}
+
+// the columns (1-based) among cols of no term u, 0 alone if none; returns their number
+static int step_colfit(const step_batch *sb, const int *cols, int kc, int u, int *colfit)
+{
+	int j, nfit = 0;
+
+	for(j = 0; j < kc; j++)
+		if(sb->colterm[cols[j]] != u)
+			colfit[nfit++] = j + 1;
+	if(nfit == 0)
+		colfit[nfit++] = 0;
+	return nfit;
+}
+
+static void step_run(void *ctx, int c, int threads, int tid, lf_arena *ws)
+{
+	step_batch *sb = (step_batch *) ctx;
+	size_t k = sb->k;
+	int t = sb->cand[c], j, kc, nfit, *cols = sb->cols + tid * k, *colfit = sb->colfit + tid * k;
+	double *beta = sb->beta + c * k, *b0 = sb->b0 + tid * k;
+	size_t need;
+	lf_sub *q;
+
+	sb->warning_prob[c] = 0;
+	if(sb->dir < 0) {
+		q = sb->sub, cols = sb->mcols, kc = sb->nmcols;
+	} else {
+		q = sb->sub + tid;
+		kc = model_columns(sb->colterm, sb->in, sb->k, t, cols);
+		sub_design(sb->dat, cols, kc, q);
+	}
+	for(j = 0; j < kc; j++)
+		beta[j] = (sb->colterm[cols[j]] == t) ? 0.0 : sb->cur[cols[j]];
+	if(sb->dir < 0) {
+		nfit = step_colfit(sb, cols, kc, t, colfit);
+		step_fit(sb, &q->p, beta, colfit, nfit, threads, tid, ws, sb->loglik + c, sb->warning_prob + c);
+		return;
+	}
+
+	// forward: the model with the term, then without it from its estimates, as logistftest
+	for(j = 0; j < kc; j++)
+		colfit[j] = j + 1;
+	if(!step_fit(sb, &q->p, beta, colfit, kc, threads, tid, ws, sb->loglik + c, sb->warning_prob + c))
+		return;
+	need = ws->need;
+	for(j = 0; j < kc; j++)
+		b0[j] = (sb->colterm[cols[j]] == t) ? 0.0 : beta[j];
+	nfit = step_colfit(sb, cols, kc, t, colfit);
+	step_fit(sb, &q->p, b0, colfit, nfit, threads, tid, ws, sb->llnull + c, sb->warning_prob + c);
+	if(ws->need < need)
+		ws->need = need;	// the arenas are sized by the larger fit
+}
+
+// each run starts from the estimates of the current model
+static void step_restart(void *ctx, int c)
+{
+	(void) ctx, (void) c;
+}
+
+static lf_arena *step_arena(void *ctx, int c)
+{
+	(void) c;
+	return ((step_batch *) ctx)->ws;
+}
+
+// the fit of all columns of the current model (columns mcols) on its design sub[0] from cur, serially;
+// cur holds the estimates (0 for the columns of the other terms), returns the log-likelihood
+static double step_refit(step_batch *sb, double *cur, lf_arena *local, int *warn)
+{
+	int j, kc = sb->nmcols;
+	double ll, *b = sb->b0;
+
+	sub_design(sb->dat, sb->mcols, kc, sb->sub);
+	for(j = 0; j < kc; j++) {
+		b[j] = cur[sb->mcols[j]];
+		sb->colfit[j] = j + 1;
+	}
+	step_fit(sb, &sb->sub->p, b, sb->colfit, kc, sb->s->threads, 0, sb->ws, &ll, warn);
+	if(sb->ws != local)
+		ws_reserve(sb->ws);
+	memset(cur, 0, sb->k * sizeof(double));
+	for(j = 0; j < kc; j++)
+		cur[sb->mcols[j]] = b[j];
+	return ll;
+}
+
+// Stepwise selection of terms by penalized likelihood ratio tests (backward.logistf, forward.logistf) on
+// one design of all terms. terms is the list of the columns (1-based) of each of the nt terms; the
+// columns of no term (the intercept) are in every model. Each model is fitted on the design of its own
+// columns (see sub_design), so its penalty is that of logistf on the model. inmodel flags the terms of the
+// starting model, whose fit starts from init, and eligible the terms that may be dropped (direction -1)
+// or added (direction 1). A term is not dropped while another term of the model contains it (contains is
+// nt x nt, contains[s + t nt] if term t contains term s).
+// Each step tests all candidates from the current estimates (the columns of the term at 0), in parallel
+// with threads > 1 (see batch_run; the candidate of the largest fit sizes the arenas). Backward, as
+// drop1, the model without the term is fitted on the design of the current model; the term of largest
+// p-value (the first of ties) is dropped unless its p-value is below sl, and the model without it is
+// refitted on its own design. Elimination stops at one column besides those of no term. Forward, as
+// add1, the model with the term and, on its design, the model without it are fitted; the term of
+// smallest p-value (ties: largest chi-squared) is added unless its p-value exceeds sl, and its fit is the
+// current model of the next step.
+// Returns per step the term changed (1-based) and its chi-squared, df and p-value, the chi-squared and
+// p-values of all candidates of each evaluation (nt x evaluations, NA for terms not tested), the final
+// inmodel, beta and log-likelihood, and warning_prob of any fit.
+SEXP logistf_stepwise_call(SEXP x, SEXP y, SEXP weight, SEXP offset, SEXP init, SEXP terms, SEXP inmodel,
+                           SEXP eligible, SEXP contains, SEXP direction, SEXP sl, SEXP steps, SEXP settings)
+{
+	int nprot = 0;
+	int n, k, nt, t, u, j, c, nc, dir, steps_i, nthreads, nstep = 0, neval = 0, warn = 0, first;
+	int *colterm, *ntcol, **tcol, *in, *elig, *cont, *cand, *sterm;
+	double sl_d, llcur, *cur, *schisq, *spval, *echisq, *epval;
+	lf_control s;
+	lf_arena local = {0};
+	lf_data dat;
+	step_batch sb = {0};
+	SEXP v, res_in, res_beta, st, sc, sd, sp, ec, ep;
+
+	get_data(x, y, weight, offset, &nprot, "logistf_stepwise_call", &dat);
+	n = dat.n, k = dat.k;
+	init = asRealVector(init, &nprot);
+	inmodel = asIntegerVector(inmodel, &nprot);
+	eligible = asIntegerVector(eligible, &nprot);
+	contains = asIntegerVector(contains, &nprot);
+	nt = LENGTH(terms);
+	if(LENGTH(init) != k || LENGTH(inmodel) != nt || LENGTH(eligible) != nt || LENGTH(contains) != nt * nt)
+		error("logistf_stepwise_call: non-conforming arguments");
+	dir = (asInteger(direction) < 0) ? -1 : 1;
+	sl_d = asReal(sl), steps_i = asInteger(steps);
+	lf_control_from_sexp(settings, &s);
+	if(steps_i == NA_INTEGER || steps_i < 0)
+		steps_i = 0;
+	if(steps_i > nt)
+		steps_i = nt;	// each step changes a different term
+
+	// the term of each column (-1: none)
+	colterm = (int *) R_alloc(k, sizeof(int));
+	for(j = 0; j < k; j++)
+		colterm[j] = -1;
+	tcol = (int **) R_alloc(nt + 1, sizeof(int *));
+	ntcol = (int *) R_alloc(nt + 1, sizeof(int));
+	for(t = 0; t < nt; t++) {
+		v = asIntegerVector(VECTOR_ELT(terms, t), &nprot);
+		ntcol[t] = LENGTH(v);
+		tcol[t] = INTEGER(v);
+		if(ntcol[t] < 1)
+			error("logistf_stepwise_call: invalid column index");
+		for(j = 0; j < ntcol[t]; j++) {
+			if(tcol[t][j] < 1 || tcol[t][j] > k || colterm[tcol[t][j] - 1] != -1)
+				error("logistf_stepwise_call: invalid column index");
+			colterm[tcol[t][j] - 1] = t;
+		}
+	}
+	in = (int *) R_alloc(nt + 1, sizeof(int));
+	elig = INTEGER(eligible), cont = INTEGER(contains);
+	for(t = 0; t < nt; t++)
+		in[t] = (INTEGER(inmodel)[t] != 0);
+
+	// per candidate its estimates and results; designs, column sets and output buffers per thread
+	// (backward: one design, that of the current model)
+	nthreads = (s.threads < nt) ? s.threads : nt;
+	if(nthreads < 1)
+		nthreads = 1;
+	sb.dat = &dat, sb.s = &s, sb.ws = (dat.ws != NULL) ? dat.ws : &local;	// no design: R_alloc, but record the size of the workspace
+	sb.k = k, sb.n = n, sb.dir = dir, sb.colterm = colterm, sb.in = in;
+	sb.sub = (lf_sub *) R_alloc(nthreads, sizeof(lf_sub));
+	for(j = 0; j < ((dir < 0) ? 1 : nthreads); j++)
+		sub_alloc(&dat, sb.sub + j);
+	sb.mcols = (int *) R_alloc(k + 1, sizeof(int));
+	sb.cols = (int *) R_alloc((size_t) nthreads * k + 1, sizeof(int));
+	sb.colfit = (int *) R_alloc((size_t) nthreads * k + 1, sizeof(int));
+	sb.b0 = (double *) R_alloc((size_t) nthreads * k + 1, sizeof(double));
+	sb.var = (double *) R_alloc((size_t) nthreads * k * k + 1, sizeof(double));
+	sb.Ustar = (double *) R_alloc((size_t) nthreads * k + 1, sizeof(double));
+	sb.pi = (double *) R_alloc((size_t) nthreads * n + 1, sizeof(double));
+	sb.Hdiag = (double *) R_alloc((size_t) nthreads * n + 1, sizeof(double));
+	sb.beta = (double *) R_alloc((size_t) nt * k + 1, sizeof(double));
+	sb.loglik = (double *) R_alloc(nt + 1, sizeof(double));
+	sb.llnull = (double *) R_alloc(nt + 1, sizeof(double));
+	sb.warning_prob = (int *) R_alloc(nt + 1, sizeof(int));
+	sb.cand = cand = (int *) R_alloc(nt + 1, sizeof(int));
+	cur = (double *) R_alloc(k, sizeof(double));
+	sb.cur = cur;
+	sterm = (int *) R_alloc(steps_i + 1, sizeof(int));
+	schisq = (double *) R_alloc(2 * (size_t) (steps_i + 1), sizeof(double));
+	spval = schisq + steps_i + 1;
+	echisq = (double *) R_alloc(2 * (size_t) nt * (steps_i + 1) + 1, sizeof(double));
+	epval = echisq + (size_t) nt * (steps_i + 1);
+
+	// the starting model
+	memcpy(cur, REAL(init), k * sizeof(double));
+	sb.nmcols = model_columns(colterm, in, k, -1, sb.mcols);
+	{
+		const void *vmax = vmaxget();
+		llcur = step_refit(&sb, cur, &local, &warn);
+		vmaxset(vmax);
+	}
+
+	while(nstep < steps_i) {
+		const void *vmax = vmaxget();
+		int best = -1, incols = 0;
+		double pbest = 0.0;
+
+		for(j = 0; j < k; j++)
+			incols += (colterm[j] >= 0 && in[colterm[j]]);
+		if(dir < 0 && incols <= 1)
+			break;
+		// candidates: the eligible terms of the model not contained in another one / not in the model
+		for(t = 0, nc = 0; t < nt; t++) {
+			int ok = elig[t] && (dir < 0) == (in[t] != 0);
+			for(u = 0; ok && dir < 0 && u < nt; u++)
+				ok = (u == t || !in[u] || !cont[t + (size_t) u * nt]);
+			if(ok)
+				cand[nc++] = t;
+		}
+		if(nc == 0)
+			break;
+		// the largest fit first: backward the candidate of fewest columns dropped, forward of most added
+		for(c = 1, first = 0; c < nc; c++)
+			if(dir * ntcol[cand[c]] > dir * ntcol[cand[first]])
+				first = c;
+		{
+			lf_batch b = {nc, first, s.threads, 0, &sb, step_run, step_restart, step_arena, &local};
+			batch_run(&b);
+		}
+
+		// PLR tests of the candidates, as drop1 / add1
+		for(t = 0; t < nt; t++)
+			echisq[(size_t) neval * nt + t] = epval[(size_t) neval * nt + t] = NA_REAL;
+		for(c = 0; c < nc; c++) {
+			double chisq = (dir < 0) ? 2.0 * (llcur - sb.loglik[c]) : 2.0 * (sb.loglik[c] - sb.llnull[c]), pv;
+			t = cand[c];
+			pv = 1.0 - Rf_pchisq(chisq, (double) ntcol[t], 1, 0);
+			echisq[(size_t) neval * nt + t] = chisq;
+			epval[(size_t) neval * nt + t] = pv;
+			warn |= sb.warning_prob[c];
+			if(best < 0 || (dir < 0 ? pv > pbest : (pv < pbest || (pv == pbest &&
+			   chisq > echisq[(size_t) neval * nt + cand[best]])))) {
+				best = c;
+				pbest = pv;
+			}
+		}
+		neval++;
+		if(dir < 0 ? pbest < sl_d : pbest > sl_d) {
+			vmaxset(vmax);
+			break;
+		}
+
+		// the current model of the next step: backward refitted without the term from the estimates of
+		// its test, forward the fit with the term
+		t = cand[best];
+		if(dir < 0) {
+			double *bb = sb.beta + (size_t) best * k;
+			memset(cur, 0, k * sizeof(double));
+			for(j = 0; j < sb.nmcols; j++)
+				cur[sb.mcols[j]] = bb[j];
+			in[t] = 0;
+			sb.nmcols = model_columns(colterm, in, k, -1, sb.mcols);
+			llcur = step_refit(&sb, cur, &local, &warn);
+		} else {
+			double *bb = sb.beta + (size_t) best * k;
+			int kc = model_columns(colterm, in, k, t, sb.cols);
+			memset(cur, 0, k * sizeof(double));
+			for(j = 0; j < kc; j++)
+				cur[sb.cols[j]] = bb[j];
+			in[t] = 1;
+			sb.nmcols = model_columns(colterm, in, k, -1, sb.mcols);
+			llcur = sb.loglik[best];
+		}
+		sterm[nstep] = t + 1;
+		schisq[nstep] = echisq[(size_t) (neval - 1) * nt + t];
+		spval[nstep] = pbest;
+		nstep++;
+		vmaxset(vmax);
+	}
+	res_in = PROTECT(allocVector(LGLSXP, nt)); nprot++;
+	for(t = 0; t < nt; t++)
+		LOGICAL(res_in)[t] = in[t];
+	res_beta = PROTECT(allocVector(REALSXP, k)); nprot++;
+	memcpy(REAL(res_beta), cur, k * sizeof(double));
+	st = PROTECT(allocVector(INTSXP, nstep)); nprot++;
+	sc = PROTECT(allocVector(REALSXP, nstep)); nprot++;
+	sd = PROTECT(allocVector(INTSXP, nstep)); nprot++;
+	sp = PROTECT(allocVector(REALSXP, nstep)); nprot++;
+	for(j = 0; j < nstep; j++) {
+		INTEGER(st)[j] = sterm[j];
+		REAL(sc)[j] = schisq[j];
+		INTEGER(sd)[j] = ntcol[sterm[j] - 1];
+		REAL(sp)[j] = spval[j];
+	}
+	ec = PROTECT(allocMatrix(REALSXP, nt, neval)); nprot++;
+	ep = PROTECT(allocMatrix(REALSXP, nt, neval)); nprot++;
+	memcpy(REAL(ec), echisq, (size_t) nt * neval * sizeof(double));
+	memcpy(REAL(ep), epval, (size_t) nt * neval * sizeof(double));
+
+	const char *names[] = {"term", "chisq", "df", "pval", "chisq.all", "pval.all", "inmodel", "beta", "loglik",
+		"warning_prob"};
+	SEXP values[] = {st, sc, sd, sp, ec, ep, res_in, res_beta, PROTECT(ScalarReal(llcur)), PROTECT(ScalarInteger(warn))};
+	nprot += 2;
+	SEXP res = namedList(names, values, 10);
+	UNPROTECT(nprot);
+	return res;
+}
+
+// Profile of variable pos (1-based) on grid (ascending values): the other columns colfit (0: none)
+// are refitted at each knot. The knots below init[pos - 1] and those above are two chains that run
+// outward from the estimate, each knot starting from the fit at its neighbour. The chains are the jobs
+// of a batch (see batch_run): job 0 is the first knot of the upper chain, which sizes the arenas, job 1
+// the lower chain and job 2 the rest of the upper chain, so with threads > 1 the two chains run in
+// parallel; a chain is restarted from init as a whole. A chain ends at its first knot with fitted
+// probabilities numerically 0 or 1.
+// Returns per knot the log-likelihood and iterations (NA beyond the end of a chain) and warning_prob.
+typedef struct {
+	const lf_problem *p;
+	const lf_control *s;
+	lf_arena *ws;
+	int k, n, pos, *knots[2], nknots[2], *colfit, ncolfit, whole;
+	const double *init, *values;
+	double *beta, *var, *Ustar, *pi, *Hdiag, *loglik;
+	int *iter, warn[2];
+} profile_batch;
+
+static void profile_run(void *ctx, int j, int threads, int tid, lf_arena *ws)
+{
+	profile_batch *pb = (profile_batch *) ctx;
+	int c = (j == 1) ? 0 : 1, from = (j == 2 && !pb->whole) ? 1 : 0, to = (j == 0) ? 1 : pb->nknots[c];
+	int t;
+	size_t k = pb->k, n = pb->n;
+	double *beta = pb->beta + c * k;
+	lf_control s = *pb->s;
+
+	(void) tid;	// the buffers are those of the chain
+	if(j == 2 && from == 1 && (pb->nknots[1] == 0 || pb->iter[pb->knots[1][0]] == NA_INTEGER))
+		return;		// the upper chain ended at its first knot
+	s.maxit = (pb->colfit[0] == 0) ? 0 : pb->s->maxit;
+	s.threads = threads;
+	for(t = from; t < to && t < pb->nknots[c]; t++) {
+		lf_fit f = {beta, pb->var + c * k * k, pb->Ustar + c * k, pb->pi + c * n, pb->Hdiag + c * n,
+			0.0, {0.0, 0.0, 0.0}, 0, 0, 0};
+		beta[pb->pos] = pb->values[pb->knots[c][t]];
+		lf_fit_run(pb->p, pb->colfit, pb->ncolfit, &s, &f, ws);
+		if(ws->collect && ws->status != LF_OK)
+			return;
+		if(f.warning_prob) {
+			pb->warn[c] = 1;
+			break;
+		}
+		pb->loglik[pb->knots[c][t]] = f.loglik;
+		pb->iter[pb->knots[c][t]] = f.iter;
+	}
+}
+
+static void profile_restart(void *ctx, int j)
+{
+	profile_batch *pb = (profile_batch *) ctx;
+	int c = (j == 1) ? 0 : 1;
+	memcpy(pb->beta + (size_t) c * pb->k, pb->init, pb->k * sizeof(double));
+	if(c == 1)
+		pb->whole = 1;
+}
+
+static lf_arena *profile_arena(void *ctx, int j)
+{
+	(void) j;
+	return ((profile_batch *) ctx)->ws;
+}
+
+SEXP logistf_profile_call(SEXP x, SEXP y, SEXP weight, SEXP offset, SEXP init, SEXP pos, SEXP grid, SEXP colfit,
+                          SEXP settings)
+{
+	int nprot = 0;
+	int n, k, m, j, c, pos_i, ncolfit, *cols;
+	double *v;
+	lf_control s;
+	lf_problem p;
+	lf_arena local = {0};
+	SEXP ll, it;
+	lf_data dat;
+	profile_batch pb = {0};
+
+	get_data(x, y, weight, offset, &nprot, "logistf_profile_call", &dat);
+	n = dat.n, k = dat.k;
+	init = asRealVector(init, &nprot);
+	grid = asRealVector(grid, &nprot);
+	colfit = asIntegerVector(colfit, &nprot);
+	pos_i = asInteger(pos);
+	m = LENGTH(grid);
+	ncolfit = LENGTH(colfit);
+	cols = INTEGER(colfit);
+	if(LENGTH(init) != k)
+		error("logistf_profile_call: non-conforming arguments");
+	if(pos_i < 1 || pos_i > k || ncolfit < 1)
+		error("logistf_profile_call: invalid column index");
+	for(j = 0; j < ncolfit && !(ncolfit == 1 && cols[0] == 0); j++)
+		if(cols[j] < 1 || cols[j] > k || cols[j] == pos_i)
+			error("logistf_profile_call: invalid column index");
+	p = data_problem(&dat);
+	lf_control_from_sexp(settings, &s);
+
+	// chain 0: the knots below the estimate downward, chain 1: the others upward
+	v = REAL(grid);
+	for(j = 0; j < m && v[j] < REAL(init)[pos_i - 1]; j++)
+		;
+	pb.nknots[0] = j, pb.nknots[1] = m - j;
+	pb.knots[0] = (int *) R_alloc(m + 1, sizeof(int));
+	pb.knots[1] = pb.knots[0] + pb.nknots[0];
+	for(j = 0; j < pb.nknots[0]; j++)
+		pb.knots[0][j] = pb.nknots[0] - 1 - j;
+	for(j = 0; j < pb.nknots[1]; j++)
+		pb.knots[1][j] = pb.nknots[0] + j;
+
+	ll = PROTECT(allocVector(REALSXP, m)); nprot++;
+	it = PROTECT(allocVector(INTSXP, m)); nprot++;
+	pb.loglik = REAL(ll), pb.iter = INTEGER(it);
+	for(j = 0; j < m; j++) {
+		pb.loglik[j] = NA_REAL;
+		pb.iter[j] = NA_INTEGER;
+	}
+	// per chain its current beta and the output buffers not returned
+	pb.p = &p, pb.s = &s, pb.ws = (dat.ws != NULL) ? dat.ws : &local;
+	pb.k = k, pb.n = n, pb.pos = pos_i - 1, pb.colfit = cols, pb.ncolfit = ncolfit;
+	pb.init = REAL(init), pb.values = v;
+	pb.beta = (double *) R_alloc(2 * (size_t) k, sizeof(double));
+	pb.var = (double *) R_alloc(2 * (size_t) k * k, sizeof(double));
+	pb.Ustar = (double *) R_alloc(2 * (size_t) k, sizeof(double));
+	pb.pi = (double *) R_alloc(2 * (size_t) n + 1, sizeof(double));
+	pb.Hdiag = (double *) R_alloc(2 * (size_t) n + 1, sizeof(double));
+	for(c = 0; c < 2; c++)
+		memcpy(pb.beta + (size_t) c * k, REAL(init), k * sizeof(double));
+	{
+		lf_batch b = {3, 0, s.threads, 0, &pb, profile_run, profile_restart, profile_arena, &local};
+		batch_run(&b);
+	}
+
+	const char *names[] = {"loglik", "iter", "warning_prob"};
+	SEXP values[] = {ll, it, PROTECT(ScalarInteger(pb.warn[0] || pb.warn[1]))};
+	nprot++;
+	SEXP res = namedList(names, values, 3);
+	UNPROTECT(nprot);
+	return res;
+}
+
+// Data of the list of m >= 1 prepared designs of k columns each (the imputed data sets of CLIP and
+// logistf.mi), their problems in *p, their arenas in *ws and the largest number of rows in *nmax
+static lf_data *get_designs(SEXP designs, const char *caller, lf_problem **p, lf_arena ***ws, int *nmax)
+{
+	int i, m = LENGTH(designs), nprot = 0;
+	lf_data *dat;
+
+	if(TYPEOF(designs) != VECSXP || m < 1)
+		error("%s: no data sets", caller);
+	dat = (lf_data *) R_alloc(m, sizeof(lf_data));
+	*p = (lf_problem *) R_alloc(m, sizeof(lf_problem));
+	*ws = (lf_arena **) R_alloc(m, sizeof(lf_arena *));
+	*nmax = 1;
+	for(i = 0; i < m; i++) {
+		if(TYPEOF(VECTOR_ELT(designs, i)) != EXTPTRSXP)
+			error("%s: the data sets must be prepared designs", caller);
+		get_data(VECTOR_ELT(designs, i), R_NilValue, R_NilValue, R_NilValue, &nprot, caller, dat + i);
+		(*p)[i] = data_problem(dat + i);
+		(*ws)[i] = dat[i].ws;
+		if(dat[i].k != dat[0].k)
+			error("%s: non-conforming arguments", caller);
+		if(dat[i].n > *nmax)
+			*nmax = dat[i].n;
+	}
+	return dat;
+}
+
+// Constrained fits of m imputed data sets for CLIP (see CLIP.confint): designs is a list of m prepared
+// designs of k columns, and data set i is refitted from column i of init (k x m) with column pos
+// (1-based) fixed at b and all other columns fitted. With threads > 1 the data sets are fitted in
+// parallel, each on the arena of its design (see batch_run). Returns the fitted beta (k x m, the
+// starting values of the next evaluation) and per data set the log-likelihood, iterations and
+// warning_prob.
+SEXP logistf_clip_call(SEXP designs, SEXP init, SEXP pos, SEXP b, SEXP settings)
+{
+	int nprot = 0;
+	int m, k, i, j, pos_i, nmax, ncolfit, *colfit, *d;
+	double b_d, *start;
+	lf_control s;
+	lf_problem *p;
+	lf_arena **ws;
+	fit_batch fb = {0};
+	SEXP bt, ll, it, wp;
+
+	m = LENGTH(designs);
+	init = asRealVector(init, &nprot);
+	pos_i = asInteger(pos), b_d = asReal(b);
+	get_designs(designs, "logistf_clip_call", &p, &ws, &nmax);
+	k = p[0].k;
+	if(LENGTH(init) != k * m)
+		error("logistf_clip_call: non-conforming arguments");
+	if(pos_i < 1 || pos_i > k)
+		error("logistf_clip_call: invalid column index");
+	lf_control_from_sexp(settings, &s);
+
+	// all columns but pos (0: only evaluate the likelihood)
+	colfit = (int *) R_alloc(k, sizeof(int));
+	for(j = 0, ncolfit = 0; j < k; j++)
+		if(j != pos_i - 1)
+			colfit[ncolfit++] = j + 1;
+	if(ncolfit == 0)
+		colfit[ncolfit++] = 0;
+
+	bt = PROTECT(duplicate(init)); nprot++;
+	ll = PROTECT(allocVector(REALSXP, m)); nprot++;
+	it = PROTECT(allocVector(INTSXP, m)); nprot++;
+	wp = PROTECT(allocVector(INTSXP, m)); nprot++;
+	for(i = 0; i < m; i++)
+		REAL(bt)[(size_t) i * k + pos_i - 1] = b_d;
+	start = (double *) R_alloc((size_t) k * m, sizeof(double));
+	memcpy(start, REAL(bt), (size_t) k * m * sizeof(double));
+	d = (int *) R_alloc(m, sizeof(int));
+	fb.colfit = (int **) R_alloc(m, sizeof(int *));
+	fb.ncolfit = (int *) R_alloc(m, sizeof(int));
+	for(i = 0; i < m; i++) {
+		d[i] = i;
+		fb.colfit[i] = colfit;
+		fb.ncolfit[i] = ncolfit;
+	}
+	fb.p = p, fb.ws = ws, fb.d = d, fb.s = &s, fb.start = start;
+	fb.beta = REAL(bt), fb.loglik = REAL(ll), fb.iter = INTEGER(it), fb.warning_prob = INTEGER(wp);
+	fb.evals = (int *) R_alloc(m, sizeof(int));
+	fb.conv = (double *) R_alloc(3 * (size_t) m, sizeof(double));
+	fit_batch_buffers(&fb, k, nmax, (s.threads < m) ? s.threads : m);
+	fit_batch_run_all(&fb, m, 0, 1, NULL);
+
+	const char *names[] = {"beta", "loglik", "iter", "warning_prob"};
+	SEXP values[] = {bt, ll, it, wp};
+	SEXP res = namedList(names, values, 4);
+	UNPROTECT(nprot);
+	return res;
+}
+
+// Batch of fits on several prepared designs (the imputed data sets of logistf.mi): job j fits the columns
+// colfits[[j]] (1-based, 0: evaluate the likelihood only) of design data[j] (1-based index into designs)
+// from column j of init (k x q). With threads > 1 the jobs run in parallel (see batch_run); the caller
+// passes the job with most columns on the largest data set first. Returns beta (k x q), the covariance
+// matrices of the first nvar jobs (k x k x nvar) and per job the log-likelihood, iterations, evaluations,
+// convergence criteria (3 x q) and warning_prob.
+SEXP logistf_mi_call(SEXP designs, SEXP data, SEXP init, SEXP colfits, SEXP nvar, SEXP settings)
+{
+	int nprot = 0;
+	int m, k, q, j, nvar_i, nmax, *d;
+	lf_control s;
+	lf_problem *p;
+	lf_arena **ws;
+	fit_batch fb = {0};
+	SEXP beta, vr, ll, it, ev, conv, wp;
+
+	m = LENGTH(designs);
+	get_designs(designs, "logistf_mi_call", &p, &ws, &nmax);
+	k = p[0].k;
+	data = asIntegerVector(data, &nprot);
+	init = asRealVector(init, &nprot);
+	q = LENGTH(colfits);
+	nvar_i = asInteger(nvar);
+	if(q < 1 || LENGTH(data) != q || LENGTH(init) != k * q || nvar_i < 0 || nvar_i > q)
+		error("logistf_mi_call: non-conforming arguments");
+	d = (int *) R_alloc(q, sizeof(int));
+	for(j = 0; j < q; j++) {
+		if(INTEGER(data)[j] < 1 || INTEGER(data)[j] > m)
+			error("logistf_mi_call: invalid data set index");
+		d[j] = INTEGER(data)[j] - 1;
+	}
+	lf_control_from_sexp(settings, &s);
+	fb.colfit = (int **) R_alloc(q, sizeof(int *));
+	fb.ncolfit = (int *) R_alloc(q, sizeof(int));
+	column_sets(colfits, k, fb.colfit, fb.ncolfit, &nprot, "logistf_mi_call");
+
+	beta = PROTECT(duplicate(init)); nprot++;
+	vr = PROTECT(alloc3DArray(REALSXP, k, k, nvar_i)); nprot++;
+	ll = PROTECT(allocVector(REALSXP, q)); nprot++;
+	it = PROTECT(allocVector(INTSXP, q)); nprot++;
+	ev = PROTECT(allocVector(INTSXP, q)); nprot++;
+	conv = PROTECT(allocMatrix(REALSXP, 3, q)); nprot++;
+	wp = PROTECT(allocVector(INTSXP, q)); nprot++;
+	memset(REAL(conv), 0, 3 * (size_t) q * sizeof(double));
+	fb.p = p, fb.ws = ws, fb.d = d, fb.s = &s, fb.start = REAL(init);
+	fb.nvar = nvar_i, fb.var = REAL(vr);
+	fb.beta = REAL(beta), fb.loglik = REAL(ll), fb.conv = REAL(conv);
+	fb.evals = INTEGER(ev), fb.iter = INTEGER(it), fb.warning_prob = INTEGER(wp);
+	fit_batch_buffers(&fb, k, nmax, (s.threads < q) ? s.threads : q);
+	fit_batch_run_all(&fb, q, 0, 0, NULL);
+
+	const char *names[] = {"beta", "var", "loglik", "iter", "evals", "conv", "warning_prob"};
+	SEXP values[] = {beta, vr, ll, it, ev, conv, wp};
+	SEXP res = namedList(names, values, 7);
+	UNPROTECT(nprot);
+	return res;
+}
+
+// Profile likelihood searches of a batch (see batch_run): search j of the limits of variable var[j]
+// (1-based, which[j] -1: lower, 1: upper limit) on problem p[d[j]] (p[0] if d is NULL) with target
+// log-likelihood LL0[d[j]] starts from column j of start (k x ns) and ends at column j of beta. Its
+// history of beta is kept in hist (k x maxit per search) if keep, and in the buffer of its thread
+// otherwise; its trace is recorded in tr[j] if tr is not NULL.
+typedef struct {
+	const lf_problem *p;
+	lf_arena **ws;
+	const int *d, *var, *which;
+	int k, keep, firth, maxit, maxhs, lowmem, accel;
+	double maxstep, lconv, xconv, tau;
+	const double *start;
+	double *LL0, *beta, *hist, *loglik, *conv;
+	size_t hsize;
+	int *iter, *warning_prob;
+	lf_trace **tr;
+} pl_batch;
+
+static void pl_run(void *ctx, int j, int threads, int tid, lf_arena *ws)
+{
+	pl_batch *pb = (pl_batch *) ctx;
+	int i = pb->d ? pb->d[j] : 0, n = pb->p[i].n, k = pb->k, var = pb->var[j], which = pb->which[j];
+	double t0 = 0.0;
+
+	(void) threads;	// one search runs on one thread
+	if(pb->tr != NULL) {
+		lf_trace_reset(pb->tr[j]);
+		ws->trace = pb->tr[j];
+		t0 = lf_clock();
+	}
+	logistplfit_ws(pb->p[i].x, pb->p[i].xs, pb->p[i].y, &n, &k, pb->p[i].weight, pb->p[i].offset,
+		pb->beta + (size_t) j * k, &var, &which, pb->LL0 + i, &pb->firth, &pb->maxit, &pb->maxstep,
+		&pb->maxhs, &pb->lconv, &pb->xconv, &pb->tau, &pb->lowmem, &pb->accel,
+		pb->hist + (pb->keep ? (size_t) j : (size_t) tid) * pb->hsize, pb->loglik + j, pb->iter + j,
+		pb->conv + 2 * (size_t) j, pb->warning_prob + j, ws);
+	if(pb->tr != NULL) {
+		pb->tr[j]->total = lf_clock() - t0;
+		ws->trace = NULL;
+	}
+}
+
+static void pl_restart(void *ctx, int j)
+{
+	pl_batch *pb = (pl_batch *) ctx;
+	memcpy(pb->beta + (size_t) j * pb->k, pb->start + (size_t) j * pb->k, pb->k * sizeof(double));
+}
+
+static lf_arena *pl_arena(void *ctx, int j)
+{
+	pl_batch *pb = (pl_batch *) ctx;
+	return pb->ws[pb->d ? pb->d[j] : 0];
+}
+
+// settings of the profile likelihood searches (see logistpl.control)
+static void pl_batch_control(pl_batch *pb, SEXP firth, SEXP maxit, SEXP maxstep, SEXP maxhs, SEXP lconv,
+                             SEXP xconv, SEXP tau, SEXP lowmem, SEXP accel)
+{
+	pb->firth = asInteger(firth), pb->maxit = asInteger(maxit), pb->maxhs = asInteger(maxhs);
+	pb->lowmem = asInteger(lowmem), pb->accel = asInteger(accel);
+	pb->maxstep = asReal(maxstep), pb->lconv = asReal(lconv), pb->xconv = asReal(xconv), pb->tau = asReal(tau);
+	pb->hsize = (size_t) pb->k * (pb->maxit > 0 ? pb->maxit : 1);
+}
+
+// Profile likelihood limits of the variables vars (1-based): the lower (which = -1) and upper (which = 1)
+// limit of each variable are 2 m independent searches from init, run in parallel with threads > 1 (see
+// batch_run). Returns per variable the limits (lower, upper), and as 2 x m matrices (first row lower
+// limit) the iterations, log-likelihoods and warnings, the 4 x m convergence criteria (lower
+// log-likelihood change, lower beta change, upper ...) and, if keephist is TRUE, the list of the 2 m
+// histories of beta and, if trace is TRUE, the list of the 2 m traces of the searches (in the order of
+// the histories).
+SEXP logistplfit_all_call(SEXP x, SEXP y, SEXP weight, SEXP offset, SEXP init, SEXP vars, SEXP LL0,
+                          SEXP firth, SEXP maxit, SEXP maxstep, SEXP maxhs, SEXP lconv, SEXP xconv, SEXP tau,
+                          SEXP lowmem, SEXP accel, SEXP threads, SEXP keephist, SEXP trace)
+{
+	int nprot = 0;
+	int k, m, j, threads_i, nthreads, *var, *which;
+	double LL0_d, *start;
+	long r, c;
+	lf_arena local = {0}, *ws;
+	lf_problem p;
+	pl_batch pb = {0};
+	SEXP lower, upper, it, ll, cv, wp, hist, h, trs;
+	lf_data dat;
+
+	get_data(x, y, weight, offset, &nprot, "logistplfit_all_call", &dat);
+	k = dat.k;
+	ws = (dat.ws != NULL) ? dat.ws : &local;	// no design: R_alloc, but record the size of the workspace
+	init = asRealVector(init, &nprot);
+	vars = asIntegerVector(vars, &nprot);
+	m = LENGTH(vars);
+	if(LENGTH(init) != k)
+		error("logistplfit_all_call: non-conforming arguments");
+	for(j = 0; j < m; j++)
+		if(INTEGER(vars)[j] < 1 || INTEGER(vars)[j] > k)
+			error("logistplfit_all_call: invalid variable index");
+	pb.k = k;
+	pl_batch_control(&pb, firth, maxit, maxstep, maxhs, lconv, xconv, tau, lowmem, accel);
+	LL0_d = asReal(LL0);
+	pb.keep = (asLogical(keephist) == TRUE);
+	threads_i = asInteger(threads);
+	if(threads_i == NA_INTEGER || threads_i < 1)
+		threads_i = 1;
+	nthreads = (threads_i < 2 * m) ? threads_i : 2 * m;
+
+	// search j: variable vars[j / 2], lower limit for even j
+	var = (int *) R_alloc(2 * m + 1, sizeof(int));
+	which = (int *) R_alloc(2 * m + 1, sizeof(int));
+	for(j = 0; j < 2 * m; j++) {
+		var[j] = INTEGER(vars)[j / 2];
+		which[j] = (j % 2 == 0) ? -1 : 1;
+	}
+	start = (double *) R_alloc((size_t) 2 * m * k + 1, sizeof(double));
+	pb.beta = (double *) R_alloc((size_t) 2 * m * k + 1, sizeof(double));
+	for(j = 0; j < 2 * m; j++)
+		memcpy(start + (size_t) j * k, REAL(init), k * sizeof(double));
+	memcpy(pb.beta, start, (size_t) 2 * m * k * sizeof(double));
+	pb.hist = (double *) R_alloc(pb.hsize * (pb.keep ? 2 * m : (nthreads > 1 ? nthreads : 1)), sizeof(double));
+	if(asLogical(trace) == TRUE) {
+		pb.tr = (lf_trace **) R_alloc(2 * m + 1, sizeof(lf_trace *));
+		for(j = 0; j < 2 * m; j++)
+			pb.tr[j] = trace_new(pb.maxit);
+	}
+
+	lower = PROTECT(allocVector(REALSXP, m)); nprot++;
+	upper = PROTECT(allocVector(REALSXP, m)); nprot++;
+	it = PROTECT(allocMatrix(INTSXP, 2, m)); nprot++;
+	ll = PROTECT(allocMatrix(REALSXP, 2, m)); nprot++;
+	cv = PROTECT(allocMatrix(REALSXP, 4, m)); nprot++;
+	wp = PROTECT(allocMatrix(INTSXP, 2, m)); nprot++;
+	memset(REAL(cv), 0, 4 * (size_t) m * sizeof(double));
+	p = data_problem(&dat);
+	pb.p = &p, pb.ws = &ws, pb.var = var, pb.which = which, pb.LL0 = &LL0_d, pb.start = start;
+	pb.loglik = REAL(ll), pb.iter = INTEGER(it), pb.conv = REAL(cv), pb.warning_prob = INTEGER(wp);
+	{
+		lf_batch b = {2 * m, 0, threads_i, 0, &pb, pl_run, pl_restart, pl_arena, &local};
+		batch_run(&b);
+	}
+
+	for(j = 0; j < m; j++) {
+		REAL(lower)[j] = pb.beta[(size_t) (2 * j) * k + var[2 * j] - 1];
+		REAL(upper)[j] = pb.beta[(size_t) (2 * j + 1) * k + var[2 * j] - 1];
+	}
+	if(pb.keep) {
+		hist = PROTECT(allocVector(VECSXP, 2 * m)); nprot++;
+		for(j = 0; j < 2 * m; j++) {
+			int nit = pb.iter[j];
+			h = allocMatrix(REALSXP, nit, k);
+			SET_VECTOR_ELT(hist, j, h);
+			for(c = 0; c < k; c++)
+				for(r = 0; r < nit; r++)
+					REAL(h)[r + c * nit] = pb.hist[j * pb.hsize + c * pb.maxit + r];
+		}
+	} else {
+		hist = R_NilValue;
+	}
+	if(pb.tr != NULL) {
+		trs = PROTECT(allocVector(VECSXP, 2 * m)); nprot++;
+		for(j = 0; j < 2 * m; j++)
+			SET_VECTOR_ELT(trs, j, trace_value(pb.tr[j]));
+	} else {
+		trs = R_NilValue;
+	}
+
+	const char *names[] = {"lower", "upper", "iter", "loglik", "conv", "warning_prob", "betahist", "trace"};
+	SEXP values[] = {lower, upper, it, ll, cv, wp, hist, trs};
+	SEXP res = namedList(names, values, 8);
+	UNPROTECT(nprot);
+	return res;
+}
+
+// Profile likelihood limits of the variables vars (1-based) in each of the m prepared designs (the
+// imputed data sets of logistf.mi): data set i starts from column i of init (k x m, its estimates)
+// with the target log-likelihood LL0[i]. The 2 m nv searches run in parallel with threads > 1 (see
+// batch_run), a search on the largest data set sizing the arenas. Returns the lower and upper limits
+// (nv x m) and, as 2 nv x m matrices (odd rows: lower limits), the iterations and warnings of the
+// searches.
+SEXP logistplfit_mi_call(SEXP designs, SEXP init, SEXP vars, SEXP LL0, SEXP firth, SEXP maxit, SEXP maxstep,
+                         SEXP maxhs, SEXP lconv, SEXP xconv, SEXP tau, SEXP lowmem, SEXP accel, SEXP threads)
+{
+	int nprot = 0;
+	int m, k, nv, ns, i, j, j0, threads_i, nthreads, nmax, *d, *var, *which;
+	double *start;
+	lf_problem *p;
+	lf_arena **ws;
+	lf_data *dat;
+	pl_batch pb = {0};
+	SEXP lower, upper, it, wp;
+
+	m = LENGTH(designs);
+	dat = get_designs(designs, "logistplfit_mi_call", &p, &ws, &nmax);
+	k = dat[0].k;
+	init = asRealVector(init, &nprot);
+	vars = asIntegerVector(vars, &nprot);
+	LL0 = asRealVector(LL0, &nprot);
+	nv = LENGTH(vars);
+	ns = 2 * nv * m;
+	if(LENGTH(init) != k * m || LENGTH(LL0) != m)
+		error("logistplfit_mi_call: non-conforming arguments");
+	for(j = 0; j < nv; j++)
+		if(INTEGER(vars)[j] < 1 || INTEGER(vars)[j] > k)
+			error("logistplfit_mi_call: invalid variable index");
+	pb.k = k;
+	pl_batch_control(&pb, firth, maxit, maxstep, maxhs, lconv, xconv, tau, lowmem, accel);
+	threads_i = asInteger(threads);
+	if(threads_i == NA_INTEGER || threads_i < 1)
+		threads_i = 1;
+	nthreads = (threads_i < ns) ? threads_i : ns;
+
+	lower = PROTECT(allocMatrix(REALSXP, nv, m)); nprot++;
+	upper = PROTECT(allocMatrix(REALSXP, nv, m)); nprot++;
+	it = PROTECT(allocMatrix(INTSXP, 2 * nv, m)); nprot++;
+	wp = PROTECT(allocMatrix(INTSXP, 2 * nv, m)); nprot++;
+	if(ns == 0) {
+		const char *names[] = {"lower", "upper", "iter", "warning_prob"};
+		SEXP values[] = {lower, upper, it, wp};
+		SEXP res = namedList(names, values, 4);
+		UNPROTECT(nprot);
+		return res;
+	}
+
+	// search j: data set j / (2 nv), variable vars[(j / 2) % nv], lower limit for even j
+	d = (int *) R_alloc(ns, sizeof(int));
+	var = (int *) R_alloc(ns, sizeof(int));
+	which = (int *) R_alloc(ns, sizeof(int));
+	start = (double *) R_alloc((size_t) ns * k, sizeof(double));
+	pb.beta = (double *) R_alloc((size_t) ns * k, sizeof(double));
+	for(j = 0; j < ns; j++) {
+		d[j] = j / (2 * nv);
+		var[j] = INTEGER(vars)[(j / 2) % nv];
+		which[j] = (j % 2 == 0) ? -1 : 1;
+		memcpy(start + (size_t) j * k, REAL(init) + (size_t) d[j] * k, k * sizeof(double));
+	}
+	memcpy(pb.beta, start, (size_t) ns * k * sizeof(double));
+	pb.hist = (double *) R_alloc(pb.hsize * nthreads, sizeof(double));
+	pb.loglik = (double *) R_alloc(ns, sizeof(double));
+	pb.conv = (double *) R_alloc(2 * (size_t) ns, sizeof(double));
+	memset(pb.conv, 0, 2 * (size_t) ns * sizeof(double));
+	for(i = 1, j0 = 0; i < m; i++)
+		if(dat[i].n > dat[d[j0]].n)
+			j0 = 2 * nv * i;
+	pb.p = p, pb.ws = ws, pb.d = d, pb.var = var, pb.which = which, pb.LL0 = REAL(LL0), pb.start = start;
+	pb.iter = INTEGER(it), pb.warning_prob = INTEGER(wp);
+	{
+		lf_batch b = {ns, j0, threads_i, 0, &pb, pl_run, pl_restart, pl_arena, NULL};
+		batch_run(&b);
+	}
+
+	for(j = 0; j < ns; j += 2) {
+		int var_ = var[j] - 1;
+		REAL(lower)[j / 2] = pb.beta[(size_t) j * k + var_];
+		REAL(upper)[j / 2] = pb.beta[(size_t) (j + 1) * k + var_];
+	}
+
+	const char *names[] = {"lower", "upper", "iter", "warning_prob"};
+	SEXP values[] = {lower, upper, it, wp};
+	SEXP res = namedList(names, values, 4);
+	UNPROTECT(nprot);
+	return res;
+}
+
+// Collapsing of duplicate observations: the rows with identical (x, offset, y) are grouped, to be replaced
+// by one row weighted by the sum of their weights (see logistf.collapse), i.e. each (x, offset) pattern by
+// at most one row with y = 0 and one with y = 1. A 64-bit hash per row is accumulated column by column (x is streamed in its storage
+// order) and the rows are inserted into an open-addressing table of groups that is doubled when half
+// full; rows of equal hash are compared value by value (-0 and 0 are equal).
+// Returns index, the (1-based) collapsed row of each observation, the rows numbered in order of first
+// occurrence, or NULL if all rows are distinct; the caller builds the collapsed data only if needed.
+static uint64_t hash_mix(uint64_t h)
+{
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
+}
+
+static uint64_t double_bits(double v)
+{
+	uint64_t u;
+	if(v == 0.0)
+		v = 0.0;
+	memcpy(&u, &v, sizeof(u));
+	return u;
+}
+
+static int same_row(double *x, int *y, double *offset, long n, long k, long a, long b)
+{
+	long j;
+	if(y[a] != y[b] || double_bits(offset[a]) != double_bits(offset[b]))
+		return 0;
+	for(j = 0; j < k; j++)
+		if(double_bits(x[a + j*n]) != double_bits(x[b + j*n]))
+			return 0;
+	return 1;
+}
+
+SEXP logistf_collapse_call(SEXP x, SEXP y, SEXP offset)
+{
+	int nprot = 0, n, k, m = 0, g, *first, *table, *idx;
+	size_t cap = 1024, slot;
+	long i, j;
+	uint64_t *h;
+	SEXP index;
+
+	x = asRealVector(x, &nprot);
+	y = asIntegerVector(y, &nprot);
+	offset = asRealVector(offset, &nprot);
+	n = LENGTH(y);
+	k = (n > 0) ? (int) (XLENGTH(x) / n) : 0;
+	if(XLENGTH(x) != (R_xlen_t) n * k || LENGTH(offset) != n)
+		error("logistf_collapse_call: non-conforming arguments");
+
+	h = (uint64_t *) R_alloc(n + 1, sizeof(uint64_t));
+	for(i = 0; i < n; i++)
+		h[i] = hash_mix(hash_mix(double_bits(REAL(offset)[i])) ^ (uint64_t) INTEGER(y)[i]);
+	for(j = 0; j < k; j++)
+		for(i = 0; i < n; i++)
+			h[i] = hash_mix(h[i] ^ double_bits(REAL(x)[i + j*n]));
+
+	index = PROTECT(allocVector(INTSXP, n)); nprot++;
+	idx = INTEGER(index);
+	first = (int *) R_alloc(n + 1, sizeof(int));
+	table = (int *) R_alloc(cap, sizeof(int));
+	for(slot = 0; slot < cap; slot++)
+		table[slot] = -1;
+	for(i = 0; i < n; i++) {
+		slot = h[i] & (cap - 1);
+		while((g = table[slot]) >= 0 &&
+		      !(h[first[g]] == h[i] && same_row(REAL(x), INTEGER(y), REAL(offset), n, k, first[g], i)))
+			slot = (slot + 1) & (cap - 1);
+		if(g < 0) {
+			g = m++;
+			first[g] = i;
+			table[slot] = g;
+			if(2 * (size_t) m > cap) {
+				int t;
+				cap *= 2;
+				table = (int *) R_alloc(cap, sizeof(int));
+				for(slot = 0; slot < cap; slot++)
+					table[slot] = -1;
+				for(t = 0; t < m; t++) {
+					slot = h[first[t]] & (cap - 1);
+					while(table[slot] >= 0)
+						slot = (slot + 1) & (cap - 1);
+					table[slot] = t;
+				}
+			}
+		}
+		idx[i] = g + 1;
+	}
+
+	UNPROTECT(nprot);
+	return (m < n) ? index : R_NilValue;
+}
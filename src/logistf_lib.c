@@ -0,0 +1,208 @@
+#include "lf_port.h"
+#include "logistf.h"
+
+// Plain C interface of the fitting core: no R objects, memory only from the arena and the caller's
+// allocator, errors returned as codes. The fits run with the arena in collect mode, so the fitting
+// routines never raise an R error (or allocate by R_alloc) on behalf of a caller of this interface.
+// A fit stops at the first buffer that does not fit into the arena, having recorded the size up to it:
+// the arena is grown by ws_reserve() and the fit repeated until all buffers fit. The routines allocate
+// before their first iteration, so only the first fit on a new arena pays for this.
+
+void lf_control_init(lf_control *ctl)
+{
+	ctl->method = LF_NR;
+	ctl->firth = 1;
+	ctl->maxit = 25;
+	ctl->maxhs = 0;
+	ctl->threads = 1;
+	ctl->lowmem = 0;
+	ctl->maxstep = 5;
+	ctl->lconv = ctl->gconv = ctl->xconv = 1e-5;
+	ctl->tau = 0.5;
+}
+
+void lf_arena_init(lf_arena *ws, const lf_allocator *allocator)
+{
+	memset(ws, 0, sizeof(lf_arena));
+	ws->allocator = allocator;
+}
+
+const char *lf_strerror(int code)
+{
+	switch(code) {
+	case LF_OK:			return "no error";
+	case LF_NOMEM:		return "no memory available";
+	case LF_SINGULAR:	return "Fisher information matrix numerically singular";
+	case LF_INVALID:	return "invalid arguments";
+	default:			return "unknown error";
+	}
+}
+
+void lf_trace_reset(lf_trace *tr)
+{
+	memset(tr->time, 0, sizeof(tr->time));
+	tr->total = 0.0;
+	tr->halvings = tr->clips = tr->niter = 0;
+}
+
+static void *lf_malloc(const lf_allocator *a, size_t bytes)
+{
+	return (a != NULL) ? a->alloc(bytes, a->ctx) : malloc(bytes);
+}
+
+static void lf_mfree(const lf_allocator *a, void *p)
+{
+	if(p == NULL)
+		return;
+	if(a != NULL)
+		a->free(p, a->ctx);
+	else
+		free(p);
+}
+
+static int problem_valid(const lf_problem *p)
+{
+	return p != NULL && p->n > 0 && p->k > 0 && (p->x != NULL || p->xs != NULL) && p->y != NULL &&
+		p->weight != NULL && p->offset != NULL;
+}
+
+void lf_fit_run(const lf_problem *p, int *colfit, int ncolfit, const lf_control *ctl, lf_fit *fit, lf_arena *ws)
+{
+	int n = p->n, k = p->k, firth = ctl->firth, maxit = ctl->maxit, maxhs = ctl->maxhs;
+	int threads = ctl->threads, lowmem = ctl->lowmem;
+	double maxstep = ctl->maxstep, lconv = ctl->lconv, gconv = ctl->gconv, xconv = ctl->xconv, tau = ctl->tau;
+
+	if(ctl->method == LF_IRLS)
+		logistffit_IRLS_ws(p->x, p->xs, p->y, &n, &k, p->weight, p->offset, fit->beta, colfit, &ncolfit,
+			&firth, &maxit, &maxstep, &maxhs, &lconv, &gconv, &xconv, &tau, &threads, &lowmem,
+			fit->var, fit->pi, fit->hdiag, &fit->loglik, &fit->evals, &fit->iter, fit->conv, &fit->warning_prob, ws);
+	else
+		(ctl->method == LF_TR ? logistffit_TR_ws : logistffit_revised_ws)(p->x, p->xs, p->y, &n, &k,
+			p->weight, p->offset, fit->beta, colfit, &ncolfit,
+			&firth, &maxit, &maxstep, &maxhs, &lconv, &gconv, &xconv, &tau, &threads, &lowmem,
+			fit->var, fit->score, fit->pi, fit->hdiag, &fit->loglik, &fit->evals, &fit->iter, fit->conv,
+			&fit->warning_prob, ws);
+}
+
+int lf_fit_model(const lf_problem *p, const int *colfit, int ncolfit, const lf_control *ctl, lf_fit *fit,
+	lf_arena *ws)
+{
+	lf_arena local;
+	lf_fit f;
+	const lf_allocator *a;
+	char *tmp;
+	double *init;
+	int *cols, j, code, collect;
+
+	if(!problem_valid(p) || ctl == NULL || fit == NULL || fit->beta == NULL || fit->var == NULL ||
+	   fit->pi == NULL || fit->hdiag == NULL)
+		return LF_INVALID;
+	if(colfit == NULL)
+		ncolfit = p->k;
+	else if(ncolfit < 1)
+		return LF_INVALID;
+	for(j = 0; colfit != NULL && j < ncolfit; j++)
+		if(colfit[j] < 1 || colfit[j] > p->k)
+			return LF_INVALID;
+	if(ws == NULL) {
+		lf_arena_init(&local, NULL);
+		ws = &local;
+	}
+	a = ws->allocator;
+
+	// starting values (for repeated fits), score and columns, not in the arena, which the fit resets
+	tmp = (char *) lf_malloc(a, 2 * (size_t) p->k * sizeof(double) + (size_t) ncolfit * sizeof(int));
+	if(tmp == NULL)
+		return LF_NOMEM;
+	init = (double *) tmp;
+	cols = (int *) (init + 2 * (size_t) p->k);
+	memcpy(init, fit->beta, p->k * sizeof(double));
+	for(j = 0; j < ncolfit; j++)
+		cols[j] = (colfit != NULL) ? colfit[j] : j + 1;
+	f = *fit;
+	if(f.score == NULL)
+		f.score = init + p->k;
+	memset(f.conv, 0, sizeof(f.conv));
+	f.iter = f.evals = f.warning_prob = 0;
+
+	collect = ws->collect;
+	ws->collect = 1;
+	for(;;) {
+		double t0 = 0.0;
+		ws->status = LF_OK;
+		if(ws->trace != NULL) {
+			lf_trace_reset(ws->trace);
+			t0 = lf_clock();
+		}
+		lf_fit_run(p, cols, ncolfit, ctl, &f, ws);
+		if(ws->trace != NULL)
+			ws->trace->total = lf_clock() - t0;
+		code = ws->status;
+		if(code != LF_NOMEM || ws->need <= ws->size || ws_reserve(ws) != LF_OK)
+			break;
+		memcpy(f.beta, init, p->k * sizeof(double));
+	}
+	ws->collect = collect;
+
+	f.score = fit->score;
+	*fit = f;
+	lf_mfree(a, tmp);
+	if(ws == &local)
+		ws_free(&local);
+	return code;
+}
+
+int lf_profile_limit(const lf_problem *p, int i, int which, double LL0, const lf_control *ctl, int accel,
+	double *beta, double *loglik, int *iter, double *conv, int *warning_prob, lf_arena *ws)
+{
+	lf_arena local;
+	const lf_allocator *a;
+	double *init, *betahist;
+	int n, k, firth, maxit, maxhs, lowmem, code, collect;
+	double maxstep, lconv, xconv, tau;
+
+	if(!problem_valid(p) || ctl == NULL || i < 1 || i > p->k || (which != -1 && which != 1) ||
+	   beta == NULL || loglik == NULL || iter == NULL || conv == NULL || warning_prob == NULL)
+		return LF_INVALID;
+	if(ws == NULL) {
+		lf_arena_init(&local, NULL);
+		ws = &local;
+	}
+	a = ws->allocator;
+	n = p->n, k = p->k, firth = ctl->firth, maxit = ctl->maxit, maxhs = ctl->maxhs, lowmem = ctl->lowmem;
+	maxstep = ctl->maxstep, lconv = ctl->lconv, xconv = ctl->xconv, tau = ctl->tau;
+
+	init = (double *) lf_malloc(a, (size_t) k * (1 + (maxit > 0 ? maxit : 1)) * sizeof(double));
+	if(init == NULL)
+		return LF_NOMEM;
+	betahist = init + k;
+	memcpy(init, beta, k * sizeof(double));
+	*iter = *warning_prob = 0;
+	conv[0] = conv[1] = 0.0;
+
+	collect = ws->collect;
+	ws->collect = 1;
+	for(;;) {
+		double t0 = 0.0;
+		ws->status = LF_OK;
+		if(ws->trace != NULL) {
+			lf_trace_reset(ws->trace);
+			t0 = lf_clock();
+		}
+		logistplfit_ws(p->x, p->xs, p->y, &n, &k, p->weight, p->offset, beta, &i, &which, &LL0, &firth,
+			&maxit, &maxstep, &maxhs, &lconv, &xconv, &tau, &lowmem, &accel,
+			betahist, loglik, iter, conv, warning_prob, ws);
+		if(ws->trace != NULL)
+			ws->trace->total = lf_clock() - t0;
+		code = ws->status;
+		if(code != LF_NOMEM || ws->need <= ws->size || ws_reserve(ws) != LF_OK)
+			break;
+		memcpy(beta, init, k * sizeof(double));
+	}
+	ws->collect = collect;
+
+	lf_mfree(a, init);
+	if(ws == &local)
+		ws_free(&local);
+	return code;
+}
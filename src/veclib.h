@@ -1,12 +1,7 @@
 #ifndef ___VECLIB_H
 #define ___VECLIB_H
 
-#include <math.h>						// powf, ...
-#include <R.h>
-#include <Rdefines.h>				
-#include "memory.h"					// malloc; free 
-#include <R_ext/Linpack.h>	// inverse; choleski; determinant
-#include "Rmath.h"					// random numbers; distributions
+#include "lf_port.h"				// R or standalone runtime: BLAS/LAPACK, math, memory
 
 
 // fast copy of array X to array res, type double
@@ -52,15 +47,222 @@ void copyCols(double *X, double *res, long n, long *inds, long n_inds)
 					 n * sizeof(double));
 }
 
-// product of k x m matrix and m x k matrix (XY); only diagonal! (k x 1)
-void XYdiag(double *X, double *Y, double *res, long k, long m)
+// Matrix kernels: by default the products are computed by R's BLAS (dgemm, dgemv, dsyrk), 
+// so any optimized BLAS R is linked against (OpenBLAS, MKL, Accelerate) speeds up every fit. 
+// Compiling with -DLOGISTF_NO_BLAS selects the cache-tiled loops below instead.
+#define TILE 256
+
+// Small-k kernels: for k <= SMALLK coefficients the k x k products, the Cholesky factorization and its
+// uses are dominated by call and loop overhead rather than arithmetic. The bodies below are written for
+// a general k but inlined into one function per k = 1..SMALLK (SMALLK_FUNS), in which k is a constant, so
+// the compiler unrolls the loops over the coefficients and keeps the accumulators in registers. The
+// generic kernels (XXtasy, XXtacc, chol_*) dispatch to them by k. Compiling with -DLOGISTF_NO_SMALLK
+// disables them.
+#ifndef LOGISTF_NO_SMALLK
+#define SMALLK 16
+
+// loops over the coefficients: fully unrolled when k is a constant
+#if defined(__clang__)
+#define SK_INLINE static inline __attribute__((always_inline))
+#define SK_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__)
+#define SK_INLINE static inline __attribute__((always_inline))
+#define SK_UNROLL _Pragma("GCC unroll 16")
+#else
+#define SK_INLINE static inline
+#define SK_UNROLL
+#endif
+
+// ZZ' (Z is k x n) into the lower triangle of res (k x k), added to res if acc, filled symmetrically otherwise
+SK_INLINE void sk_xxt(double *Z, double *res, long k, long n, int acc)
+{
+	double s[SMALLK * SMALLK], *z, tmp;
+	long i, j, l;
+
+	SK_UNROLL
+	for(j = 0; j < k * k; j++)
+		s[j] = 0.0;
+	for(i = 0; i < n; i++) {
+		z = Z + i*k;
+		SK_UNROLL
+		for(j = 0; j < k; j++) {
+			tmp = z[j];
+			SK_UNROLL
+			for(l = j; l < k; l++)
+				s[l + j*k] += z[l] * tmp;
+		}
+	}
+	for(j = 0; j < k; j++)
+		for(l = j; l < k; l++) {
+			if(acc) {
+				res[l + j*k] += s[l + j*k];
+			} else {
+				res[l + j*k] = s[l + j*k];
+				res[j + l*k] = s[l + j*k];
+			}
+		}
+}
+
+// Cholesky factor of A in the lower triangle of L (the upper triangle is a copy of A, as with dpotrf);
+// returns 0 on success, otherwise the order of the first non-positive leading minor
+SK_INLINE int sk_chol(double *A, double *L, long k)
 {
+	long i, j, l;
 	double tmp;
-	for(long i=0; i < k; i++) {
+
+	SK_UNROLL
+	for(i = 0; i < k * k; i++)
+		L[i] = A[i];
+	SK_UNROLL
+	for(j = 0; j < k; j++) {
+		tmp = L[j + j*k];
+		SK_UNROLL
+		for(l = 0; l < j; l++)
+			tmp -= L[j + l*k] * L[j + l*k];
+		if(!(tmp > 0.0))
+			return (int) j + 1;
+		L[j + j*k] = tmp = sqrt(tmp);
+		SK_UNROLL
+		for(i = j + 1; i < k; i++) {
+			double v = L[i + j*k];
+			SK_UNROLL
+			for(l = 0; l < j; l++)
+				v -= L[i + l*k] * L[j + l*k];
+			L[i + j*k] = v / tmp;
+		}
+	}
+	return 0;
+}
+
+// solve L L' X = B for m right hand sides; B (k x m) is overwritten by X
+SK_INLINE void sk_solve(double *L, double *B, long k, long m)
+{
+	long i, j, r;
+	double *b;
+
+	for(r = 0; r < m; r++) {
+		b = B + r*k;
+		SK_UNROLL
+		for(i = 0; i < k; i++) {
+			SK_UNROLL
+			for(j = 0; j < i; j++)
+				b[i] -= L[i + j*k] * b[j];
+			b[i] /= L[i + i*k];
+		}
+		SK_UNROLL
+		for(i = k - 1; i >= 0; i--) {
+			SK_UNROLL
+			for(j = i + 1; j < k; j++)
+				b[i] -= L[j + i*k] * b[j];
+			b[i] /= L[i + i*k];
+		}
+	}
+}
+
+// (L L')^(-1) = L^(-T) L^(-1) ; res (k x k) is filled symmetrically
+SK_INLINE void sk_inv(double *L, double *res, long k)
+{
+	double Li[SMALLK * SMALLK], tmp;
+	long i, j, l;
+
+	// L^(-1), lower triangular
+	SK_UNROLL
+	for(j = 0; j < k; j++) {
+		Li[j + j*k] = 1.0 / L[j + j*k];
+		SK_UNROLL
+		for(i = j + 1; i < k; i++) {
+			tmp = 0.0;
+			SK_UNROLL
+			for(l = j; l < i; l++)
+				tmp -= L[i + l*k] * Li[l + j*k];
+			Li[i + j*k] = tmp / L[i + i*k];
+		}
+	}
+	SK_UNROLL
+	for(j = 0; j < k; j++) {
+		SK_UNROLL
+		for(i = j; i < k; i++) {
+			tmp = 0.0;
+			SK_UNROLL
+			for(l = i; l < k; l++)
+				tmp += Li[l + i*k] * Li[l + j*k];
+			res[i + j*k] = tmp;
+			res[j + i*k] = tmp;
+		}
+	}
+}
+
+// squared norms of the columns of L^(-1) Z (Z is k x n and is overwritten by L^(-1) Z)
+SK_INLINE void sk_hatdiag(double *L, double *Z, double *res, long k, long n)
+{
+	double d[SMALLK], *z, tmp;
+	long i, j, r;
+
+	SK_UNROLL
+	for(i = 0; i < k; i++)
+		d[i] = 1.0 / L[i + i*k];
+	for(r = 0; r < n; r++) {
+		z = Z + r*k;
 		tmp = 0.0;
-		for(long ind = 0; ind < m; ind++)
-			tmp += X[ind * k + i] * Y[ind + i * m];
-		res[i] = tmp;
+		SK_UNROLL
+		for(j = 0; j < k; j++) {
+			z[j] *= d[j];
+			tmp += z[j] * z[j];
+			SK_UNROLL
+			for(i = j + 1; i < k; i++)
+				z[i] -= L[i + j*k] * z[j];
+		}
+		res[r] = tmp;
+	}
+}
+
+#define SMALLK_FUNS(K) \
+	static void sk_xxt_##K(double *Z, double *res, long n, int acc) { sk_xxt(Z, res, K, n, acc); } \
+	static int sk_chol_##K(double *A, double *L) { return sk_chol(A, L, K); } \
+	static void sk_solve_##K(double *L, double *B, long m) { sk_solve(L, B, K, m); } \
+	static void sk_inv_##K(double *L, double *res) { sk_inv(L, res, K); } \
+	static void sk_hatdiag_##K(double *L, double *Z, double *res, long n) { sk_hatdiag(L, Z, res, K, n); }
+
+SMALLK_FUNS(1)  SMALLK_FUNS(2)  SMALLK_FUNS(3)  SMALLK_FUNS(4)
+SMALLK_FUNS(5)  SMALLK_FUNS(6)  SMALLK_FUNS(7)  SMALLK_FUNS(8)
+SMALLK_FUNS(9)  SMALLK_FUNS(10) SMALLK_FUNS(11) SMALLK_FUNS(12)
+SMALLK_FUNS(13) SMALLK_FUNS(14) SMALLK_FUNS(15) SMALLK_FUNS(16)
+
+#define SMALLK_TABLE(f) {NULL, f##_1, f##_2, f##_3, f##_4, f##_5, f##_6, f##_7, f##_8, \
+	f##_9, f##_10, f##_11, f##_12, f##_13, f##_14, f##_15, f##_16}
+
+static void (*const sk_xxt_k[SMALLK + 1])(double *, double *, long, int) = SMALLK_TABLE(sk_xxt);
+static int (*const sk_chol_k[SMALLK + 1])(double *, double *) = SMALLK_TABLE(sk_chol);
+static void (*const sk_solve_k[SMALLK + 1])(double *, double *, long) = SMALLK_TABLE(sk_solve);
+static void (*const sk_inv_k[SMALLK + 1])(double *, double *) = SMALLK_TABLE(sk_inv);
+static void (*const sk_hatdiag_k[SMALLK + 1])(double *, double *, double *, long) = SMALLK_TABLE(sk_hatdiag);
+
+#define IS_SMALLK(k) ((k) >= 1 && (k) <= SMALLK)
+// beyond SMALLK_GRAM coefficients the accumulators of sk_xxt no longer fit in registers and dsyrk is faster
+#ifndef LOGISTF_NO_BLAS
+#define SMALLK_GRAM 10
+#else
+#define SMALLK_GRAM SMALLK
+#endif
+#define IS_SMALLK_GRAM(k) ((k) >= 1 && (k) <= SMALLK_GRAM)
+#else
+#define IS_SMALLK(k) 0
+#define IS_SMALLK_GRAM(k) 0
+#endif
+
+// product of k x m matrix and m x k matrix (XY); only diagonal! (k x 1)
+void XYdiag(double *X, double *Y, double *res, long k, long m)
+{
+	long i, ind, i0, i1;
+	
+	for(i=0; i < k; i++)
+		res[i] = 0.0;
+	// tiles of TILE rows of X, so the columns of Y stay in cache while X is streamed
+	for(i0 = 0; i0 < k; i0 += TILE) {
+		i1 = (i0 + TILE < k) ? i0 + TILE : k;
+		for(ind = 0; ind < m; ind++)
+			for(i = i0; i < i1; i++)
+				res[i] += X[ind * k + i] * Y[ind + i * m];
 	}
 }
 
@@ -68,30 +270,60 @@ void XYdiag(double *X, double *Y, double *res, long k, long m)
 // cross-product of k x m matrix and k x n matrix (X'Y)  ; result is m x n
 void XtY(double *X, double *Y, double *res, long k, long m, long n)
 {
-	long i, j, ind;
+#ifndef LOGISTF_NO_BLAS
+	int k_i = (int) k, m_i = (int) m, n_i = (int) n, one_i = 1;
+	double one = 1.0, zero = 0.0;
+	if(n == 1)
+		F77_CALL(dgemv)("T", &k_i, &m_i, &one, X, &k_i, Y, &one_i, &zero, res, &one_i FCONE);
+	else
+		F77_CALL(dgemm)("T", "N", &m_i, &n_i, &k_i, &one, X, &k_i, Y, &k_i, &zero, res, &m_i FCONE FCONE);
+#else
+	long i, j, ind, i0, i1;
 	double tmp;
 	
-	for(i=0; i < m; i++)
-		for(j=0; j < n; j++) {
-			tmp = 0.0;
-			for(ind = 0; ind < k; ind++)
-				tmp += X[ind + i*k] * Y[ind + j*k];
-			res[i + j*m] = tmp;
-		}
+	for(i=0; i < m*n; i++)
+		res[i] = 0.0;
+	// tiles of TILE rows, so the column segments of X and Y stay in cache
+	for(i0 = 0; i0 < k; i0 += TILE) {
+		i1 = (i0 + TILE < k) ? i0 + TILE : k;
+		for(i=0; i < m; i++)
+			for(j=0; j < n; j++) {
+				tmp = 0.0;
+				for(ind = i0; ind < i1; ind++)
+					tmp += X[ind + i*k] * Y[ind + j*k];
+				res[i + j*m] += tmp;
+			}
+	}
+#endif
 }
-// cross-product of m x k matrix and k x n matrix (XY)  ; result is m x n
-void XY(double *X, double *Y, double *res,long k, long m, long n)
+
+// product of m x k matrix and k x n matrix (XY)  ; result is m x n
+void XY(double *X, double *Y, double *res, long k, long m, long n)
 {
-	long i, j, ind;
+#ifndef LOGISTF_NO_BLAS
+	int k_i = (int) k, m_i = (int) m, n_i = (int) n, one_i = 1;
+	double one = 1.0, zero = 0.0;
+	if(n == 1)
+		F77_CALL(dgemv)("N", &m_i, &k_i, &one, X, &m_i, Y, &one_i, &zero, res, &one_i FCONE);
+	else
+		F77_CALL(dgemm)("N", "N", &m_i, &n_i, &k_i, &one, X, &m_i, Y, &k_i, &zero, res, &m_i FCONE FCONE);
+#else
+	long i, j, ind, i0, i1;
 	double tmp;
 	
-	for(i=0; i < m; i++)
-		for(j=0; j < n; j++) {
-			tmp = 0.0;
-			for(ind = 0; ind < m; ind++)
-				tmp += X[i + ind*m] * Y[ind + j*k];
-			res[i + j*m] = tmp;
-		}
+	for(i=0; i < m*n; i++)
+		res[i] = 0.0;
+	// column-oriented (axpy) order, in tiles of TILE rows
+	for(i0 = 0; i0 < m; i0 += TILE) {
+		i1 = (i0 + TILE < m) ? i0 + TILE : m;
+		for(j=0; j < n; j++)
+			for(ind = 0; ind < k; ind++) {
+				tmp = Y[ind + j*k];
+				for(i = i0; i < i1; i++)
+					res[i + j*m] += X[i + ind*m] * tmp;
+			}
+	}
+#endif
 }
 
 // X'X (X is k x k)
@@ -113,29 +345,235 @@ void XtXsym(double *X, double *res, long *k_l)
 // X'X (X is k x m)  ;  result is m x m
 void XtXasy(double *X, double *res, long k, long m)
 {
+	long i, j;
+#ifndef LOGISTF_NO_BLAS
+	int k_i = (int) k, m_i = (int) m;
+	double one = 1.0, zero = 0.0;
+	F77_CALL(dsyrk)("L", "T", &m_i, &k_i, &one, X, &k_i, &zero, res, &m_i FCONE FCONE);
+#else
+	long ind, i0, i1;
+	
+	for(i=0; i < m*m; i++)
+		res[i] = 0.0;
+	// tiles of TILE rows, so all m column segments of a tile stay in cache
+	for(i0 = 0; i0 < k; i0 += TILE) {
+		i1 = (i0 + TILE < k) ? i0 + TILE : k;
+		for(j=0; j < m; j++)
+			for(i=j; i < m; i++)
+				for(ind = i0; ind < i1; ind++)
+					res[i + j*m] += X[ind + i*k] * X[ind + j*k];
+	}
+#endif
+	for(j=0; j < m; j++)
+		for(i=0; i < j; i++)
+			res[i + j*m] = res[j + i*m];
+}
+
+// XX' (X is k x m)  ;  result is k x k
+void XXtasy(double *X, double *res, long k, long m)
+{
+	long i, j;
+#ifndef LOGISTF_NO_SMALLK
+	if(IS_SMALLK_GRAM(k)) {
+		sk_xxt_k[k](X, res, m, 0);
+		return;
+	}
+#endif
+#ifndef LOGISTF_NO_BLAS
+	int k_i = (int) k, m_i = (int) m;
+	double one = 1.0, zero = 0.0;
+	F77_CALL(dsyrk)("L", "N", &k_i, &m_i, &one, X, &k_i, &zero, res, &k_i FCONE FCONE);
+#else
+	long ind;
+	double tmp;
+	
+	for(i=0; i < k*k; i++)
+		res[i] = 0.0;
+	// rank-one updates with the contiguous columns of X
+	for(ind = 0; ind < m; ind++)
+		for(j=0; j < k; j++) {
+			tmp = X[j + ind*k];
+			for(i=j; i < k; i++)
+				res[i + j*k] += X[i + ind*k] * tmp;
+		}
+#endif
+	for(j=0; j < k; j++)
+		for(i=0; i < j; i++)
+			res[i + j*k] = res[j + i*k];
+}
+
+// res += XX' (X is k x m, res is k x k) ; lower triangle only
+void XXtacc(double *X, double *res, long k, long m)
+{
+#ifndef LOGISTF_NO_SMALLK
+	if(IS_SMALLK_GRAM(k)) {
+		sk_xxt_k[k](X, res, m, 1);
+		return;
+	}
+#endif
+#ifndef LOGISTF_NO_BLAS
+	int k_i = (int) k, m_i = (int) m;
+	double one = 1.0;
+	F77_CALL(dsyrk)("L", "N", &k_i, &m_i, &one, X, &k_i, &one, res, &k_i FCONE FCONE);
+#else
 	long i, j, ind;
 	double tmp;
 	
-	for(i=0; i < m; i++)
-		for(j=i; j < m; j++) {
+	for(ind = 0; ind < m; ind++)
+		for(j=0; j < k; j++) {
+			tmp = X[j + ind*k];
+			for(i=j; i < k; i++)
+				res[i + j*k] += X[i + ind*k] * tmp;
+		}
+#endif
+}
+
+// Row-partitioned kernels for threaded fits: the n observations are split into 'threads' contiguous
+// blocks, each block is handled by one OpenMP thread, and per-block partial sums are added up in block
+// order afterwards. The result therefore only depends on the number of threads, not on the scheduling.
+// With threads = 1 they reduce to the serial kernels above.
+
+// first and one-past-last observation of block b out of nblk
+void block_range(long n, int nblk, int b, long *i0, long *i1)
+{
+	*i0 = (n * b) / nblk;
+	*i1 = (n * (b + 1)) / nblk;
+}
+
+// product of rows i0..i1-1 of the n x k matrix X and the vector b ; result is (i1-i0) x 1
+void XYrows(double *X, double *b, double *res, long n, long k, long i0, long i1)
+{
+	if(i1 <= i0)
+		return;
+#ifndef LOGISTF_NO_BLAS
+	int n_i = (int) n, m_i = (int) (i1 - i0), k_i = (int) k, one_i = 1;
+	double one = 1.0, zero = 0.0;
+	F77_CALL(dgemv)("N", &m_i, &k_i, &one, X + i0, &n_i, b, &one_i, &zero, res, &one_i FCONE);
+#else
+	long i, j, t0, t1;
+	double tmp;
+	
+	for(i = 0; i < i1 - i0; i++)
+		res[i] = 0.0;
+	for(t0 = i0; t0 < i1; t0 += TILE) {
+		t1 = (t0 + TILE < i1) ? t0 + TILE : i1;
+		for(j = 0; j < k; j++) {
+			tmp = b[j];
+			for(i = t0; i < t1; i++)
+				res[i - i0] += X[i + j*n] * tmp;
+		}
+	}
+#endif
+}
+
+// cross-product of rows i0..i1-1 of the n x k matrix X and the vector w ; result is k x 1
+void XtYrows(double *X, double *w, double *res, long n, long k, long i0, long i1)
+{
+	long j;
+	if(i1 <= i0) {
+		for(j = 0; j < k; j++)
+			res[j] = 0.0;
+		return;
+	}
+#ifndef LOGISTF_NO_BLAS
+	int n_i = (int) n, m_i = (int) (i1 - i0), k_i = (int) k, one_i = 1;
+	double one = 1.0, zero = 0.0;
+	F77_CALL(dgemv)("T", &m_i, &k_i, &one, X + i0, &n_i, w + i0, &one_i, &zero, res, &one_i FCONE);
+#else
+	long i, t0, t1;
+	double tmp;
+	
+	for(j = 0; j < k; j++)
+		res[j] = 0.0;
+	for(t0 = i0; t0 < i1; t0 += TILE) {
+		t1 = (t0 + TILE < i1) ? t0 + TILE : i1;
+		for(j = 0; j < k; j++) {
 			tmp = 0.0;
-			for(ind = 0; ind < k; ind++)
-				tmp += X[ind + i*k] * X[ind + j*k];
-			res[i + j*m] = res[j + i*m] = tmp;
+			for(i = t0; i < t1; i++)
+				tmp += X[i + j*n] * w[i];
+			res[j] += tmp;
 		}
+	}
+#endif
+}
+
+// X b for the n x k matrix X ; result is n x 1
+void XYpar(double *X, double *b, double *res, long n, long k, int threads)
+{
+	if(threads <= 1) {
+		XY(X, b, res, k, n, 1);
+		return;
+	}
+	int blk;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1;
+		block_range(n, threads, blk, &i0, &i1);
+		XYrows(X, b, res + i0, n, k, i0, i1);
+	}
+}
+
+// X'w for the n x k matrix X ; result is k x 1 ; part: workspace of threads * k
+void XtYpar(double *X, double *w, double *res, long n, long k, int threads, double *part)
+{
+	if(threads <= 1) {
+		XtY(X, w, res, n, k, 1);
+		return;
+	}
+	int blk;
+	long j;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1;
+		block_range(n, threads, blk, &i0, &i1);
+		XtYrows(X, w, part + blk*k, n, k, i0, i1);
+	}
+	copy(part, res, k);
+	for(blk = 1; blk < threads; blk++)
+		for(j = 0; j < k; j++)
+			res[j] += part[blk*k + j];
+}
+
+// ZZ' for the k x n matrix Z ; result is k x k ; part: workspace of threads * k * k
+void XXtpar(double *Z, double *res, long k, long n, int threads, double *part)
+{
+	if(threads <= 1) {
+		XXtasy(Z, res, k, n);
+		return;
+	}
+	int blk;
+	long j;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1;
+		block_range(n, threads, blk, &i0, &i1);
+		XXtasy(Z + i0*k, part + blk*k*k, k, i1 - i0);
+	}
+	copy(part, res, k*k);
+	for(blk = 1; blk < threads; blk++)
+		for(j = 0; j < k*k; j++)
+			res[j] += part[blk*k*k + j];
 }
 
 // t(X) (X is k x m)
 void trans(double *X, double *res, long k, long m)
 {
-	for(long i=0; i < k; i++)
-		for(long j=0; j < m; j++) {
-			res[i*m + j] = X[i + j*k];
-		  //Rprintf("trans: %f", res[i*m + j]);
+	long i, j, i0, j0, i1, j1;
+	// TILE x TILE blocks, so reads and writes both stay in cache
+	for(i0 = 0; i0 < k; i0 += TILE) {
+		i1 = (i0 + TILE < k) ? i0 + TILE : k;
+		for(j0 = 0; j0 < m; j0 += TILE) {
+			j1 = (j0 + TILE < m) ? j0 + TILE : m;
+			for(j = j0; j < j1; j++)
+				for(i = i0; i < i1; i++)
+					res[i*m + j] = X[i + j*k];
 		}
+	}
 }
 
 
+// LINPACK routines of R (not used by the fitting routines, not in the standalone library)
+#ifndef LOGISTF_STANDALONE
 // compute inverse and determinant; A_doub is changed
 void linpack_inv_det(double *A_doub, long *size, double *logdet)
 {
@@ -311,8 +749,408 @@ void linpack_choleski(double *A_doub, long *size)
 	
 
 }
+#endif
+
+
+// Cholesky factorization layer: a symmetric positive definite k x k matrix A = L L'
+// is factorized once per iteration and the factor L is reused for the log-determinant,
+// linear solves, the hat diagonal and (only when needed) the explicit inverse
+
+// factorize A into the lower triangle of L (k x k); A is unchanged
+// returns 0 on success, otherwise the order of the first non-positive leading minor
+int chol_factor(double *A, double *L, long k)
+{
+#ifndef LOGISTF_NO_SMALLK
+	if(IS_SMALLK(k))
+		return sk_chol_k[k](A, L);
+#endif
+	int k_i = (int) k, info = 0;
+	copy(A, L, k * k);
+	F77_CALL(dpotrf)("L", &k_i, L, &k_i, &info FCONE);
+	return info;
+}
+
+// log-determinant of A from the diagonal of its factor
+double chol_logdet(double *L, long k)
+{
+	double res = 0.0;
+	for(long i=0; i < k; i++)
+		res += log(L[i * (k + 1)]);
+	return 2.0 * res;
+}
+
+// solve A X = B for m right hand sides; B (k x m) is overwritten by X
+void chol_solve(double *L, double *B, long k, long m)
+{
+#ifndef LOGISTF_NO_SMALLK
+	if(IS_SMALLK(k)) {
+		sk_solve_k[k](L, B, m);
+		return;
+	}
+#endif
+	int k_i = (int) k, m_i = (int) m, info = 0;
+	F77_CALL(dpotrs)("L", &k_i, &m_i, L, &k_i, B, &k_i, &info FCONE);
+}
+
+// inverse of A from its factor; res (k x k) is filled symmetrically
+void chol_inv(double *L, double *res, long k)
+{
+#ifndef LOGISTF_NO_SMALLK
+	if(IS_SMALLK(k)) {
+		sk_inv_k[k](L, res);
+		return;
+	}
+#endif
+	int k_i = (int) k, info = 0;
+	copy(L, res, k * k);
+	F77_CALL(dpotri)("L", &k_i, res, &k_i, &info FCONE);
+	for(long j=0; j < k; j++)
+		for(long i=0; i < j; i++)
+			res[i + j*k] = res[j + i*k];
+}
+
+// diagonal of W^(1/2) X A^(-1) X' W^(1/2) with A = X'WX;
+// Z (k x n) holds (X W^(1/2))' and is overwritten by L^(-1) Z, the result are its squared column norms
+void chol_hatdiag(double *L, double *Z, double *res, long k, long n)
+{
+#ifndef LOGISTF_NO_SMALLK
+	if(IS_SMALLK(k)) {
+		sk_hatdiag_k[k](L, Z, res, n);
+		return;
+	}
+#endif
+	int k_i = (int) k, n_i = (int) n;
+	double one = 1.0, tmp;
+	F77_CALL(dtrsm)("L", "L", "N", "N", &k_i, &n_i, &one, L, &k_i, Z, &k_i FCONE FCONE FCONE FCONE);
+	for(long i=0; i < n; i++) {
+		tmp = 0.0;
+		for(long j=0; j < k; j++)
+			tmp += Z[i*k + j] * Z[i*k + j];
+		res[i] = tmp;
+	}
+}
+
+
+// chol_hatdiag for the k x n matrix Z, observations split into blocks
+void chol_hatdiagpar(double *L, double *Z, double *res, long k, long n, int threads)
+{
+	if(threads <= 1) {
+		chol_hatdiag(L, Z, res, k, n);
+		return;
+	}
+	int blk;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1;
+		block_range(n, threads, blk, &i0, &i1);
+		if(i1 > i0)
+			chol_hatdiag(L, Z + i0*k, res + i0, k, i1 - i0);
+	}
+}
+
+// Sparse kernels: the n x k matrix X in compressed rows, the nonzeros of row i being val[p[i]..p[i+1]-1]
+// in the columns col[p[i]..p[i+1]-1] (ascending). The work is of order nnz (the squared number of nonzeros
+// per row for X'WX and the hat diagonal) instead of n k. Blocks of observations as for the dense kernels.
 
+// X b ; result is n x 1
+void spXYpar(int *p, int *col, double *val, double *b, double *res, long n, int threads)
+{
+	long i;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(i = 0; i < n; i++) {
+		double tmp = 0.0;
+		for(int t = p[i]; t < p[i + 1]; t++)
+			tmp += val[t] * b[col[t]];
+		res[i] = tmp;
+	}
+}
 
+// X'w ; result is k x 1 ; part: workspace of threads * k
+void spXtYpar(int *p, int *col, double *val, double *w, double *res, long n, long k, int threads, double *part)
+{
+	int blk;
+	long j;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1, i;
+		double *acc = part + blk*k;
+		block_range(n, threads, blk, &i0, &i1);
+		for(j = 0; j < k; j++)
+			acc[j] = 0.0;
+		for(i = i0; i < i1; i++)
+			for(int t = p[i]; t < p[i + 1]; t++)
+				acc[col[t]] += val[t] * w[i];
+	}
+	copy(part, res, k);
+	for(blk = 1; blk < threads; blk++)
+		for(j = 0; j < k; j++)
+			res[j] += part[blk*k + j];
+}
+
+// X'WX with W = diag(wt) ; result is k x k, filled symmetrically ; part: workspace of threads * k * k
+void spXtWXpar(int *p, int *col, double *val, double *wt, double *res, long n, long k, int threads, double *part)
+{
+	int blk;
+	long i, j;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1, r, l;
+		double *acc = part + blk*k*k, tmp;
+		block_range(n, threads, blk, &i0, &i1);
+		for(l = 0; l < k*k; l++)
+			acc[l] = 0.0;
+		for(r = i0; r < i1; r++)
+			for(int s = p[r]; s < p[r + 1]; s++) {
+				tmp = wt[r] * val[s];
+				for(int t = s; t < p[r + 1]; t++)	// upper triangle: col[s] <= col[t]
+					acc[col[s] + col[t]*k] += tmp * val[t];
+			}
+	}
+	copy(part, res, k*k);
+	for(blk = 1; blk < threads; blk++)
+		for(i = 0; i < k*k; i++)
+			res[i] += part[blk*k*k + i];
+	for(j = 0; j < k; j++)
+		for(i = j + 1; i < k; i++)
+			res[i + j*k] = res[j + i*k];
+}
+
+// diagonal of W^(1/2) X C X' W^(1/2) for the symmetric k x k matrix C = (X'WX)^(-1) ; result is n x 1
+void sphatdiagpar(int *p, int *col, double *val, double *C, double *wt, double *res, long n, long k, int threads)
+{
+	long i;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(i = 0; i < n; i++) {
+		double h = 0.0, tmp;
+		for(int s = p[i]; s < p[i + 1]; s++) {
+			tmp = 0.5 * val[s] * C[col[s] * (k + 1)];
+			for(int t = s + 1; t < p[i + 1]; t++)
+				tmp += val[t] * C[col[s] + col[t]*k];
+			h += 2.0 * val[s] * tmp;
+		}
+		res[i] = wt[i] * h;
+	}
+}
+
+// Single precision kernels: the n x k matrix X (column-major) stored in float, halving the memory traffic
+// of the passes over the design. Products are formed and accumulated in double, so only the rounding of
+// X itself differs from the double kernels. Blocks of observations as for the dense kernels.
+
+// X b ; result is n x 1
+void fXYpar(float *X, double *b, double *res, long n, long k, int threads)
+{
+	int blk;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1, i, j, t0, t1;
+		double tmp;
+		block_range(n, threads, blk, &i0, &i1);
+		for(i = i0; i < i1; i++)
+			res[i] = 0.0;
+		for(t0 = i0; t0 < i1; t0 += TILE) {
+			t1 = (t0 + TILE < i1) ? t0 + TILE : i1;
+			for(j = 0; j < k; j++) {
+				tmp = b[j];
+				for(i = t0; i < t1; i++)
+					res[i] += (double) X[i + j*n] * tmp;
+			}
+		}
+	}
+}
+
+// X'w ; result is k x 1 ; part: workspace of threads * k
+void fXtYpar(float *X, double *w, double *res, long n, long k, int threads, double *part)
+{
+	int blk;
+	long j;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1, i, l;
+		double *acc = part + blk*k, tmp;
+		block_range(n, threads, blk, &i0, &i1);
+		for(l = 0; l < k; l++) {
+			tmp = 0.0;
+			for(i = i0; i < i1; i++)
+				tmp += (double) X[i + l*n] * w[i];
+			acc[l] = tmp;
+		}
+	}
+	copy(part, res, k);
+	for(blk = 1; blk < threads; blk++)
+		for(j = 0; j < k; j++)
+			res[j] += part[blk*k + j];
+}
+
+// Mixed kernels: column j of the n x k matrix X is column cidx[j] of the n x nd matrix D if cidx[j] >= 0,
+// else the 0/1 column -cidx[j]-1 of B, bit-packed in nw = (n+63)/64 words per column (row i in bit i%64 of
+// word i/64). A binary column costs n/64 words instead of n doubles: products with it are sums over its
+// set bits, found a word at a time (and-masked for two binary columns, so disjoint dummies of one factor
+// cost n/64 word operations). The blocks of observations are aligned to words.
+
+#if defined(__GNUC__)
+#define CTZ64(w) __builtin_ctzll(w)
+#else
+static int CTZ64(uint64_t w)
+{
+	int t = 0;
+	while(!(w & 1)) {
+		w >>= 1;
+		t++;
+	}
+	return t;
+}
+#endif
+
+// first and one-past-last observation of the word-aligned block b out of nblk
+void block_range64(long n, int nblk, int b, long *i0, long *i1)
+{
+	long w0, w1;
+	block_range((n + 63) / 64, nblk, b, &w0, &w1);
+	*i0 = w0 * 64;
+	*i1 = (w1 * 64 < n) ? w1 * 64 : n;
+}
+
+// X b ; result is n x 1
+void mXYpar(uint64_t *B, double *D, int *cidx, double *b, double *res, long n, long k, int threads)
+{
+	int blk;
+	long nw = (n + 63) / 64;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1, i, j, w;
+		uint64_t word, *Bj;
+		double *Dj, tmp;
+		block_range64(n, threads, blk, &i0, &i1);
+		for(i = i0; i < i1; i++)
+			res[i] = 0.0;
+		for(j = 0; j < k; j++) {
+			tmp = b[j];
+			if(cidx[j] >= 0) {
+				Dj = D + cidx[j]*n;
+				for(i = i0; i < i1; i++)
+					res[i] += Dj[i] * tmp;
+			} else {
+				Bj = B + (-cidx[j] - 1)*nw;
+				for(w = i0 / 64; w * 64 < i1; w++)
+					for(word = Bj[w]; word; word &= word - 1)
+						res[w*64 + CTZ64(word)] += tmp;
+			}
+		}
+	}
+}
+
+// X'w ; result is k x 1 ; part: workspace of threads * k
+void mXtYpar(uint64_t *B, double *D, int *cidx, double *w, double *res, long n, long k, int threads, double *part)
+{
+	int blk;
+	long j, nw = (n + 63) / 64;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1, i, l, t;
+		uint64_t word, *Bl;
+		double *Dl, tmp;
+		block_range64(n, threads, blk, &i0, &i1);
+		for(l = 0; l < k; l++) {
+			tmp = 0.0;
+			if(cidx[l] >= 0) {
+				Dl = D + cidx[l]*n;
+				for(i = i0; i < i1; i++)
+					tmp += Dl[i] * w[i];
+			} else {
+				Bl = B + (-cidx[l] - 1)*nw;
+				for(t = i0 / 64; t * 64 < i1; t++)
+					for(word = Bl[t]; word; word &= word - 1)
+						tmp += w[t*64 + CTZ64(word)];
+			}
+			part[blk*k + l] = tmp;
+		}
+	}
+	copy(part, res, k);
+	for(blk = 1; blk < threads; blk++)
+		for(j = 0; j < k; j++)
+			res[j] += part[blk*k + j];
+}
+
+// X'WX with W = diag(wt) ; result is k x k, filled symmetrically ; part: workspace of threads * k * k
+void mXtWXpar(uint64_t *B, double *D, int *cidx, double *wt, double *res, long n, long k, int threads, double *part)
+{
+	int blk;
+	long i, j, nw = (n + 63) / 64;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1, r, l, m, t;
+		uint64_t word, *Bl, *Bm;
+		double *acc = part + blk*k*k, *Dl, *Dm, tmp;
+		block_range64(n, threads, blk, &i0, &i1);
+		for(m = 0; m < k; m++)
+			for(l = 0; l <= m; l++) {		// upper triangle
+				tmp = 0.0;
+				if(cidx[l] >= 0 && cidx[m] >= 0) {
+					Dl = D + cidx[l]*n, Dm = D + cidx[m]*n;
+					for(r = i0; r < i1; r++)
+						tmp += wt[r] * Dl[r] * Dm[r];
+				} else if(cidx[l] < 0 && cidx[m] < 0) {
+					Bl = B + (-cidx[l] - 1)*nw, Bm = B + (-cidx[m] - 1)*nw;
+					for(t = i0 / 64; t * 64 < i1; t++)
+						for(word = Bl[t] & Bm[t]; word; word &= word - 1)
+							tmp += wt[t*64 + CTZ64(word)];
+				} else {
+					Bl = B + (-((cidx[l] < 0) ? cidx[l] : cidx[m]) - 1)*nw;
+					Dm = D + ((cidx[l] < 0) ? cidx[m] : cidx[l])*n;
+					for(t = i0 / 64; t * 64 < i1; t++)
+						for(word = Bl[t]; word; word &= word - 1) {
+							r = t*64 + CTZ64(word);
+							tmp += wt[r] * Dm[r];
+						}
+				}
+				acc[l + m*k] = tmp;
+			}
+	}
+	copy(part, res, k*k);
+	for(blk = 1; blk < threads; blk++)
+		for(i = 0; i < k*k; i++)
+			res[i] += part[blk*k*k + i];
+	for(j = 0; j < k; j++)
+		for(i = j + 1; i < k; i++)
+			res[i + j*k] = res[j + i*k];
+}
+
+// diagonal of W^(1/2) X C X' W^(1/2) for the symmetric k x k matrix C = (X'WX)^(-1) from the nonzeros of
+// each row (its dense values and set bits) ; result is n x 1 ; buf: workspace of threads * 2 * k
+void mhatdiagpar(uint64_t *B, double *D, int *cidx, double *C, double *wt, double *res, long n, long k,
+                 int threads, double *buf)
+{
+	int blk;
+	long nw = (n + 63) / 64;
+	#pragma omp parallel for num_threads(threads) schedule(static)
+	for(blk = 0; blk < threads; blk++) {
+		long i0, i1, i, j, nz, s, t;
+		double *val = buf + blk*2*k, h, tmp;
+		int *col = (int *) (val + k);
+		block_range64(n, threads, blk, &i0, &i1);
+		for(i = i0; i < i1; i++) {
+			for(j = 0, nz = 0; j < k; j++) {
+				if(cidx[j] >= 0) {
+					val[nz] = D[i + cidx[j]*n];
+					col[nz++] = j;
+				} else if((B[(-cidx[j] - 1)*nw + i / 64] >> (i % 64)) & 1) {
+					val[nz] = 1.0;
+					col[nz++] = j;
+				}
+			}
+			h = 0.0;
+			for(s = 0; s < nz; s++) {
+				tmp = 0.5 * val[s] * C[col[s] * (k + 1)];
+				for(t = s + 1; t < nz; t++)
+					tmp += val[t] * C[col[s] + col[t]*k];
+				h += 2.0 * val[s] * tmp;
+			}
+			res[i] = wt[i] * h;
+		}
+	}
+}
+
+#ifndef LOGISTF_STANDALONE
 void testRmath(void)
 {
 	double res;
@@ -331,6 +1169,6 @@ void summe(double *x, long *n, double *res)
 	for (i = 0; i < *n; i++)
 		*res += x[i];
 }
-
+#endif
 
 #endif